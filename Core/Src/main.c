@@ -37,6 +37,12 @@
 #include "spis.h"
 #include "adcs.h"
 #include "timer_test.h"
+#include "result_cache.h"
+#include "cmd_pool.h"
+#include "result_agg.h"
+#include "test_monitor.h"
+#include "tlv.h"
+#include "test_queue.h"
 
 /* USER CODE END Includes */
 
@@ -49,6 +55,10 @@
 /* USER CODE BEGIN PD */
 extern struct netif gnetif;
 
+#ifndef FIRMWARE_BUILD_ID
+#define FIRMWARE_BUILD_ID __DATE__ " " __TIME__	// Reported by the capability query, -D to override
+#endif
+
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -114,11 +124,6 @@ const osThreadAttr_t performing_task_attributes = {
   .stack_size = 2048 * 4,
   .priority = (osPriority_t) osPriorityHigh,
 };
-/* Definitions for testsQ */
-osMessageQueueId_t testsQHandle;
-const osMessageQueueAttr_t testsQ_attributes = {
-  .name = "testsQ"
-};
 /* Definitions for UartRx */
 osSemaphoreId_t UartRxHandle;
 const osSemaphoreAttr_t UartRx_attributes = {
@@ -194,17 +199,16 @@ static struct udp_pcb *udp_pcb_handle;
 void udp_receive_init(void);
 void udp_receive_callback(void *arg, struct udp_pcb *pcb,
                           struct pbuf *p, const ip_addr_t *addr, u16_t port);
-int send_response(result_pro_t result);
+int send_response(result_pro_t result, const ip_addr_t *addr, u16_t port);
+int send_datagram(const void *data, u16_t length, const ip_addr_t *addr, u16_t port);
 uint32_t calculate_crc(uint8_t *data, size_t length);
+static void preempt_running(const cmd_desc_t *running);
 
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 
-ip_addr_t g_server_addr;
-u16_t g_server_port;
-
 /* USER CODE END 0 */
 
 /**
@@ -296,12 +300,11 @@ int main(void)
   /* start timers, add new ones, ... */
   /* USER CODE END RTOS_TIMERS */
 
-  /* Create the queue(s) */
-  /* creation of testsQ */
-  testsQHandle = osMessageQueueNew (16, 4, &testsQ_attributes);
-
   /* USER CODE BEGIN RTOS_QUEUES */
   /* add queues, ... */
+  cmd_pool_init(); // One command descriptor per test queue slot
+  result_agg_init(send_datagram);
+  test_monitor_init(send_datagram, preempt_running);
   /* USER CODE END RTOS_QUEUES */
 
   /* Create the thread(s) */
@@ -319,6 +322,7 @@ int main(void)
 
   /* USER CODE BEGIN RTOS_THREADS */
   /* add threads, ... */
+  test_queue_init(performing_taskHandle); // Commands run by priority and deadline
   /* USER CODE END RTOS_THREADS */
 
   /* USER CODE BEGIN RTOS_EVENTS */
@@ -1017,76 +1021,304 @@ void udp_receive_init(void)
     udp_recv(udp_pcb_handle, udp_receive_callback, NULL);
     printf("UDP ready, listening on port %d\n\r", LOCAL_PORT);
 }
+/*
+ * A resent command: answered from the cache instead of running the test twice.
+ * @retval 1 if the command was seen before (nothing else to do), 0 for a new command.
+ */
+static uint8_t answer_resend(uint32_t test_id, const ip_addr_t *addr, u16_t port)
+{
+    result_pro_t cached;
+    CacheState state = (test_id != 0) ? result_cache_check(test_id, addr, port, &cached) : CACHE_MISS;
+    if (state == CACHE_MISS) return 0;
+
+    if (state == CACHE_DONE) send_response(cached, addr, port);
+    // CACHE_PENDING: the result is sent when the test completes
+    return 1;
+}
+
+/*
+ * Hands a command's descriptor to perform_tests() through the test queue, or rejects the
+ * command when there is no descriptor or no room in the queue.
+ */
+static void queue_command(cmd_desc_t *desc, uint32_t test_id, const ip_addr_t *addr, u16_t port, uint8_t batched)
+{
+    if (desc == NULL)
+    {
+        // Pool exhausted (the queue is full too): rejected under load
+        result_pro_t response={test_id, TEST_ERR};
+        send_response(response, addr, port);
+        return;
+    }
+    ip_addr_copy(desc->reply_addr, *addr);
+    desc->reply_port = port;
+    desc->batched = batched;
+
+    if (test_id != 0) result_cache_pending(test_id, addr, port);
+    if (!test_queue_push(desc))
+    {
+        // Rejected under load: the test ID tells the client which command to offer again
+        result_pro_t response={test_id, TEST_ERR};
+        send_response(response, addr, port);
+        if (test_id != 0) result_cache_forget(test_id, addr, port);
+        cmd_pool_release(desc);
+    }
+    // Otherwise the descriptor now belongs to perform_tests()
+}
+
+/*
+ * Answers a command that will not run (cancelled or expired while queued) with TEST_ERR,
+ * or with a result_ext_t saying why when the command asked for extended results.
+ */
+static void answer_unrun(uint32_t test_id, uint8_t extended, uint8_t failure, const ip_addr_t *addr, u16_t port)
+{
+    result_pro_t response = {test_id, TEST_ERR};
+    if (test_id != 0) result_cache_complete(response, addr, port);
+    if (extended)
+    {
+        result_ext_t ext = {.tag = RESULT_EXT_TAG, .test_id = test_id, .test_result = TEST_ERR, .failure = failure};
+        send_datagram(&ext, sizeof(ext), addr, port);
+    }
+    else
+    {
+        send_response(response, addr, port);
+    }
+}
+
+/*
+ * Queues the command at `offset` of a received frame (a single command or one of a batch).
+ * Only the frame's length is checked here, perform_tests() validates the fields.
+ * The caller keeps its own reference to the pbuf.
+ * @retval Bytes the command takes in the frame, 0 if the frame does not hold a whole command.
+ */
+static u16_t accept_command(struct pbuf *p, u16_t offset, const ip_addr_t *addr, u16_t port, uint8_t batched)
+{
+    // Full size or compact command: the header and at least bit_pattern_length bytes of pattern
+    if (p->tot_len < offset + TEST_COMMAND_HEADER_SIZE) return 0;
+    u16_t cmd_len = TEST_COMMAND_HEADER_SIZE + pbuf_get_at(p, offset + offsetof(test_command_t, bit_pattern_length));
+    if (p->tot_len < offset + cmd_len) return 0;
+
+    uint32_t test_id;
+    pbuf_copy_partial(p, &test_id, sizeof(test_id), offset);
+    if (answer_resend(test_id, addr, port)) return cmd_len;
+
+    // Zero copy: the command is read in place from the received pbuf (an RX_POOL buffer of
+    // ethernetif.c), which the descriptor holds until perform_tests() released it.
+    // A chained pbuf is copied into the descriptor's own block instead.
+    queue_command(cmd_pool_take(p, offset), test_id, addr, port, batched);
+    return cmd_len;
+}
+
+/*
+ * A cancel: the matching queued commands are answered with TEST_ERR right away (perform_tests()
+ * drops them when they come out of the test queue), a matching running test stops before its next
+ * iteration and answers for itself. Only tests sent from the canceller's address match, from the
+ * port it names (it cancels from another socket than the one its tests came from).
+ * The canceller is told how many tests were cancelled.
+ * @retval 0 on success, -1 on a malformed frame.
+ */
+static int accept_cancel(uint8_t *frame, u16_t size, const ip_addr_t *addr, u16_t port)
+{
+    static cmd_cancelled_t queued[CMD_POOL_SIZE];
+    uint32_t test_id;
+    u16_t tests_port = port;
+    uint8_t queued_count;
+
+    if (tlv_decode_cancel(frame, size, TLV_MSG_CANCEL, &test_id, &tests_port, NULL) < 0) return -1;
+    uint8_t count = cmd_pool_cancel(test_id, addr, tests_port, queued, &queued_count);
+
+    for (uint8_t i = 0; i < queued_count; i++)
+    {
+        answer_unrun(queued[i].test_id, queued[i].extended, FAILURE_CANCELLED,
+                     &queued[i].reply_addr, queued[i].reply_port);
+    }
+
+    u16_t length = tlv_encode_cancel(frame, TLV_FRAME_MAX, TLV_MSG_CANCELLED, test_id, 0, count);
+    return length > 0 ? send_datagram(frame, length, addr, port) : -1;
+}
+
+/*
+ * A TLV command: queued at its priority, with its deadline counted from now. A soak reports
+ * its counts at the end instead of progress.
+ */
+static void accept_tlv_command(const test_command_t *cmd, const tlv_sched_t *sched, const ip_addr_t *addr, u16_t port)
+{
+    if (answer_resend(cmd->test_id, addr, port)) return;
+
+    cmd_desc_t *desc = cmd_pool_take_copy(cmd);
+    if (desc != NULL)
+    {
+        desc->priority = sched->priority;
+        if (sched->deadline_ms > 0)
+        {
+            desc->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(sched->deadline_ms);
+            if (desc->deadline == 0) desc->deadline = 1;   // 0 means no deadline
+        }
+        desc->soak_iterations = sched->soak_iterations;
+        desc->soak_ms = sched->soak_ms;
+        if (desc->soak_iterations > 0 || desc->soak_ms > 0) desc->cmd->peripheral &= ~STREAM_PROGRESS;
+    }
+    queue_command(desc, cmd->test_id, addr, port, 0);
+}
+
+/*
+ * @brief Refuses a TLV frame with a TLV_MSG_ERROR, which a newer host tells apart from a test result.
+ * @param type: Message type of the refused frame, 0 if unreadable.
+ */
+static void send_tlv_error(uint8_t code, uint8_t type, const ip_addr_t *addr, u16_t port)
+{
+    uint8_t frame[TLV_HEADER_SIZE + 8];
+    u16_t length = tlv_encode_error(frame, sizeof(frame), code, type);
+    if (length > 0) send_datagram(frame, length, addr, port);
+}
+
+/*
+ * A TLV frame (tlv.h): a capability or queue statistics query or a cancel is answered here,
+ * a command is decoded into a descriptor's own block and queued like any other. A message type
+ * of a newer protocol version is refused with TLV_ERR_UNSUPPORTED.
+ * @retval 0 on success, -1 on a malformed frame.
+ */
+static int accept_tlv(struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    static uint8_t frame[TLV_FRAME_MAX];    // Only the lwIP thread gets here
+    static test_command_t cmd;
+    tlv_sched_t sched;
+    u16_t size = pbuf_copy_partial(p, frame, sizeof(frame), 0);
+    int type = tlv_message_type(frame, size);
+
+    switch (type)
+    {
+    case TLV_MSG_CAPS_QUERY:
+    {
+        tlv_caps_t caps = {
+            .version = PROTOCOL_VERSION,
+            .peripherals = TIMER | UART | SPI | I2C | ADC_P,
+            .max_pattern = MAX_BIT_PATTERN_LENGTH - 1,
+            .max_batch = COMMAND_BATCH_MAX,
+            .result_batch = RESULT_BATCH_MAX,
+            .features = FEATURE_COMPACT | FEATURE_BATCH_FRAMES | FEATURE_PROGRESS | FEATURE_EXTENDED_RESULT |
+                        FEATURE_TLV_COMMAND | FEATURE_CANCEL | FEATURE_PRIORITY | FEATURE_SOAK,
+        };
+        strncpy(caps.build_id, FIRMWARE_BUILD_ID, TLV_BUILD_ID_MAX);
+        u16_t length = tlv_encode_caps(frame, sizeof(frame), &caps);
+        return length > 0 ? send_datagram(frame, length, addr, port) : -1;
+    }
+    case TLV_MSG_COMMAND:
+        if (tlv_decode_command(frame, size, &cmd, &sched) < 0) return -1;
+        accept_tlv_command(&cmd, &sched, addr, port);
+        return 0;
+    case TLV_MSG_CANCEL:
+        return accept_cancel(frame, size, addr, port);
+    case TLV_MSG_STATS_QUERY:
+    {
+        tlv_queue_stats_t stats;
+        cmd_pool_stats_t pool;
+        test_queue_get_stats(&stats);
+        cmd_pool_get_stats(&pool);
+        stats.pool_high_water = pool.high_water;
+        stats.pool_exhausted = pool.exhausted;
+        stats.pool_copied = pool.copied;
+        u16_t length = tlv_encode_stats(frame, sizeof(frame), &stats);
+        return length > 0 ? send_datagram(frame, length, addr, port) : -1;
+    }
+    default:
+        if (type < 0) return -1;
+        send_tlv_error(TLV_ERR_UNSUPPORTED, (uint8_t)type, addr, port);
+        return 0;
+    }
+}
+
 /*
  * this function gets a received buffer then:
- * 1. alters it to a test_command_t struct
- * 2. sends it to execution queue.
- *
+ * 1. checks it holds a whole test_command_t (full size or compact), a batch frame of them
+ *    or a TLV frame (capability query or TLV encoded command)
+ * 2. takes a descriptor of the command pool for each command (no heap, constant time)
+ * 3. sends the descriptors to execution queue - the commands themselves are not copied.
+ * The test queue depth plus the running test and one preempting it (18 pbufs) stays below
+ * ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT,
+ * so queued commands never starve the Ethernet receive path.
  * */
 void udp_receive_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
     if (p != NULL) {
-        // Copy the sender's IP address
-        ip_addr_copy(g_server_addr, *addr);
-        // Copy the sender's port
-        g_server_port = port;
+        // Every reply goes to the sender of its own command: several controllers may share the UUT
+        uint32_t tag = 0;
+        if (p->tot_len >= BATCH_HEADER_SIZE) pbuf_copy_partial(p, &tag, sizeof(tag), 0);
 
-        if (p->len >= sizeof(test_command_t))
+        if (tag == COMMAND_BATCH_TAG)
         {
-            test_command_t *cmd = (test_command_t *)pvPortMalloc(sizeof(test_command_t));
-            if (cmd != NULL)
+            // Batch frame: `count` compact commands back to back, their results may share datagrams
+            u8_t count = pbuf_get_at(p, offsetof(batch_header_t, count));
+            u16_t offset = BATCH_HEADER_SIZE;
+            for (u8_t i = 0; i < count; i++)
             {
-			   // Copy the data from the pbuf payload to the allocated memory
-			   memcpy(cmd, p->payload, sizeof(test_command_t)); // Only copy the struct size
-
-	            // Send the POINTER to the newly allocated and copied* data to the queue
-	            if (xQueueSendToBack(testsQHandle, &cmd, 1) != pdPASS) // Pass address of pointer
-	            {
-	            	result_pro_t response={NULL, TEST_ERR};
-	            	send_response(response);
-	                vPortFree(cmd); // If send fails, free the allocated memory
-	            } else {
-	                // notify if successfully sent to queue
-	                xTaskNotifyGive(performing_taskHandle);
-	            }
+                u16_t cmd_len = accept_command(p, offset, addr, port, 1);
+                if (cmd_len == 0)
+                {
+                    // Truncated frame: the rest is lost, the client resends what goes unanswered
+                    result_pro_t response={0, TEST_ERR};
+                    send_response(response, addr, port);
+                    break;
+                }
+                offset += cmd_len;
             }
-            else{
-            	result_pro_t response={NULL, TEST_ERR};
-            	send_response(response);
-                printf("Failed to allocate memory for test_command_t!\n\r"); // Debug printf
+        }
+        else if (tag == TLV_TAG)
+        {
+            if (accept_tlv(p, addr, port) < 0)
+            {
+                u8_t type = 0;
+                if (p->tot_len >= TLV_HEADER_SIZE) type = pbuf_get_at(p, offsetof(tlv_header_t, type));
+                send_tlv_error(TLV_ERR_MALFORMED, type, addr, port);
             }
-        } else {
-        	result_pro_t response={NULL, TEST_ERR};
-        	send_response(response);
+        }
+        else if (accept_command(p, 0, addr, port, 0) == 0)
+        {
+        	result_pro_t response={0, TEST_ERR};
+        	send_response(response, addr, port);
         }
         pbuf_free(p);
     }
     else{
-    	result_pro_t response={NULL, TEST_ERR};
-    	send_response(response);
+    	result_pro_t response={0, TEST_ERR};
+    	send_response(response, addr, port);
     }
 }
 
-int send_response(result_pro_t result)
+/*
+ * @brief Sends a result to the controller that sent the command.
+ * @param addr, port: The command's source, kept with the queued command.
+ * @retval 0 on success, -1 on failure.
+ */
+int send_response(result_pro_t result, const ip_addr_t *addr, u16_t port)
+{
+    return send_datagram(&result, sizeof(result_pro_t), addr, port);
+}
+
+/*
+ * @brief Sends one datagram (a result or a frame of results) to addr:port.
+ * @retval 0 on success, -1 on failure.
+ */
+int send_datagram(const void *data, u16_t length, const ip_addr_t *addr, u16_t port)
 {
     // Check if we have a valid sender address
-    if (ip_addr_isany(&g_server_addr) == 0)
+    if (addr != NULL && ip_addr_isany(addr) == 0)
     {
         // Create a new pbuf for the response data
-        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, sizeof(result_pro_t), PBUF_RAM);
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
         if (p != NULL)
         {
-            // Copy the result struct into the pbuf payload
-            memcpy(p->payload, &result, sizeof(result_pro_t));
+            // Copy the data into the pbuf payload
+            memcpy(p->payload, data, length);
 
-            // Send the response to the stored address and port
-            if(udp_sendto(udp_pcb_handle, p, &g_server_addr, g_server_port) != ERR_OK)
+            // Send the response to the command's source
+            if(udp_sendto(udp_pcb_handle, p, addr, port) != ERR_OK)
             {
                 pbuf_free(p);
             	return -1;
             }
             // Free the pbuf
             pbuf_free(p);
+            return 0;
         }
         else{
         	return -1;
@@ -1171,59 +1403,209 @@ void udp_function(void *argument)
 }
 
 /* USER CODE BEGIN Header_perform_tests */
+/*
+ * Answers the queued commands whose deadline passed with TEST_ERR, without running them.
+ */
+static void answer_expired(void)
+{
+	cmd_desc_t *desc;
+	while ((desc = test_queue_take_expired()) != NULL)
+	{
+		// A cancelled one was answered by accept_cancel()
+		if (cmd_pool_start(desc))
+		{
+			answer_unrun(desc->cmd->test_id, (desc->cmd->peripheral & EXTENDED_RESULT) != 0, FAILURE_EXPIRED,
+					&desc->reply_addr, desc->reply_port);
+		}
+		cmd_pool_release(desc);
+	}
+}
+
+// Runs the peripheral test of a command
+static Result run_test(test_command_t *cmd)
+{
+	switch (cmd->peripheral & PERIPHERAL_MASK){
+	case TIMER:
+		return timer_testing(cmd);
+	case UART:
+		return uart_testing(cmd);
+	case SPI:
+		return spi_testing(cmd);
+	case I2C:
+		return i2c_testing(cmd);
+	case ADC_P:
+		return adc_testing(cmd);
+	default:
+		return TEST_ERR;
+	}
+}
+
+/*
+ * Runs a soak command: the test runs back to back, up to 255 iterations a run, until its
+ * iteration count or duration is reached. A failed iteration is counted and the next run goes
+ * on, a cancel ends the soak. The runs of a duration are sized from the iteration time measured
+ * so far, so the soak ends within about an iteration of it. The counts go back in a
+ * TLV_MSG_SOAK_RESULT.
+ */
+static void run_soak(cmd_desc_t *desc)
+{
+	test_command_t *cmd = desc->cmd;
+	tlv_soak_result_t soak = {.test_id = cmd->test_id, .result = TEST_PASS};
+	TickType_t started = xTaskGetTickCount();
+	TickType_t duration = pdMS_TO_TICKS(desc->soak_ms);
+	uint8_t frame[TLV_HEADER_SIZE + 64];
+
+	for(;;){
+		uint32_t done = soak.passed + soak.failed;
+		TickType_t elapsed = xTaskGetTickCount() - started;
+		uint32_t run = UINT8_MAX;
+
+		if (desc->soak_iterations > 0)
+		{
+			if (done >= desc->soak_iterations) break;
+			if (desc->soak_iterations - done < run) run = desc->soak_iterations - done;
+		}
+		if (desc->soak_ms > 0)
+		{
+			if (elapsed >= duration) break;
+			// The first run measures the rate with a single iteration
+			uint64_t fit = (done == 0) ? 1 : (uint64_t)(duration - elapsed) * done / (elapsed > 0 ? elapsed : 1);
+			if (fit < 1) fit = 1;
+			if (fit < run) run = (uint32_t)fit;
+		}
+
+		cmd->iterations = (uint8_t)run;
+		test_monitor_begin(desc);
+		Result result = run_test(cmd);
+		soak.passed += test_monitor_iterations();
+		test_monitor_end(result);
+		if (result == TEST_FAIL) soak.failed++;
+		else if (result == TEST_ERR)
+		{
+			soak.result = TEST_ERR;		// Cancelled
+			break;
+		}
+	}
+	soak.elapsed_ms = (xTaskGetTickCount() - started) * portTICK_PERIOD_MS;
+	if (soak.result == TEST_PASS && soak.failed > 0) soak.result = TEST_FAIL;
+
+	ip_addr_t reply_addr;
+	ip_addr_copy(reply_addr, desc->reply_addr);
+	u16_t reply_port = desc->reply_port;
+	cmd_pool_release(desc);
+	result_pro_t response = {soak.test_id, soak.result};
+	if (response.test_id != 0) result_cache_complete(response, &reply_addr, reply_port);	// A resend gets the plain result
+	u16_t length = tlv_encode_soak_result(frame, sizeof(frame), &soak);
+	if (length > 0) send_datagram(frame, length, &reply_addr, reply_port);
+}
+
+/*
+ * Runs one command taken out of the test queue and sends its result.
+ */
+static void run_command(cmd_desc_t *desc)
+{
+	test_command_t *cmd;
+
+	if (!cmd_pool_start(desc))
+	{
+		// Cancelled while queued, accept_cancel() answered it
+		cmd_pool_release(desc);
+		return;
+	}
+	// The command lies in the received frame (a compact one ends after its pattern)
+	cmd = desc->cmd;
+	result_pro_t response;
+	// A soak sets its own iteration count per run, TLV_ITERATIONS is ignored
+	uint8_t soak = desc->soak_iterations > 0 || desc->soak_ms > 0;
+
+	if(cmd->bit_pattern_length > MAX_BIT_PATTERN_LENGTH || cmd->test_id == 0 || (!soak && cmd->iterations < 1)){
+		response.test_id = cmd->test_id;
+		response.test_result =TEST_ERR;
+		if (response.test_id != 0) result_cache_complete(response, &desc->reply_addr, desc->reply_port);
+		send_response(response, &desc->reply_addr, desc->reply_port);
+		cmd_pool_release(desc);
+		return;
+	}
+	if (soak)
+	{
+		run_soak(desc);
+		return;
+	}
+	response.test_id = cmd->test_id;
+	test_monitor_begin(desc);
+	response.test_result = run_test(cmd);
+    test_monitor_end(response.test_result);
+    // The reply address outlives the descriptor
+    ip_addr_t reply_addr;
+    ip_addr_copy(reply_addr, desc->reply_addr);
+    u16_t reply_port = desc->reply_port;
+    uint8_t batched = desc->batched;
+    uint8_t extended = (cmd->peripheral & EXTENDED_RESULT) != 0;
+    cmd_pool_release(desc); // Frees the frame back to RX_POOL
+    osDelay(1);
+    if (response.test_id != 0) result_cache_complete(response, &reply_addr, reply_port);
+    if (extended) {
+        // Old clients never set the flag and keep getting the plain result_pro_t
+        result_ext_t ext;
+        test_monitor_result(&ext, response);
+        send_datagram(&ext, sizeof(ext), &reply_addr, reply_port);
+    }
+    else if (batched) {
+        // Shares a datagram with the next results, unless nothing else is queued or the oldest
+        // buffered result waited enough. While the next test runs, preempt_running() sends the
+        // buffer at the first iteration boundary after it became due.
+        result_agg_add(response, &reply_addr, reply_port);
+        if (test_queue_depth() == 0 || result_agg_due()) result_agg_flush();
+    }
+    else {
+        send_response(response, &reply_addr, reply_port);
+    }
+}
+
+/*
+ * Checkpoint of the running test (test_monitor_checkpoint), between two of its iterations:
+ * coalesced results that waited RESULT_AGG_TIMEOUT_MS are sent, expired commands are answered,
+ * and more urgent ones on other peripherals run before it goes on.
+ */
+static void preempt_running(const cmd_desc_t *running)
+{
+	cmd_desc_t *desc;
+
+	if (result_agg_due()) result_agg_flush();
+	answer_expired();
+	while ((desc = test_queue_pop_above(running)) != NULL)
+	{
+		run_command(desc);
+		answer_expired();
+	}
+}
+
 /**
 * @brief Function implementing the performing_task thread:
 * sorting the commands to its test (UART/SPI/etc.)
-* @param argument: Not used (using queue instead)
+* @param argument: Not used (using the test queue instead)
 * @retval None
 */
 /* USER CODE END Header_perform_tests */
 void perform_tests(void *argument)
 {
   /* USER CODE BEGIN perform_tests */
-	test_command_t *cmd;
+	cmd_desc_t *desc;
 
   /* Infinite loop */
   for(;;)
   {
-	ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // waiting for a notification
-
-	if (xQueueReceive(testsQHandle, &cmd, 0) != pdPASS)
+	answer_expired();
+	desc = test_queue_pop();
+	if (desc == NULL)
 	{
-		printf("perform_tests: No test command received\n\r");
+		// Nothing left to share a datagram with (the next command may have been cancelled)
+		result_agg_flush();
+		// A notification only wakes the task: it drains the queue whatever number was given
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 		continue;
 	}
-	result_pro_t response;
-
-	if(cmd->bit_pattern_length > MAX_BIT_PATTERN_LENGTH || cmd->test_id == NULL || cmd->iterations < 1){
-		response.test_result =TEST_ERR;
-		send_response(response);
-	}
-	response.test_id = cmd->test_id;
-
-	switch (cmd->peripheral){
-	case TIMER:
-		response.test_result = timer_testing(cmd);
-		break;
-	case UART:
-		response.test_result = uart_testing(cmd);
-		break;
-	case SPI:
-		response.test_result = spi_testing(cmd);
-		break;
-	case I2C:
-		response.test_result = i2c_testing(cmd);
-		break;
-	case ADC_P:
-		response.test_result = adc_testing(cmd);
-		break;
-	default:
-		response.test_result = TEST_ERR;
-        break;
-	}
-    vPortFree(cmd);
-    osDelay(1);
-    send_response(response);
+	run_command(desc);
   }
   /* USER CODE END perform_tests */
 }
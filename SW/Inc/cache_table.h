@@ -0,0 +1,36 @@
+#ifndef CACHE_TABLE_H_
+#define CACHE_TABLE_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+
+#define RESULT_CACHE_SIZE 	32 	// > TEST_QUEUE_SIZE + the running and preempting tests, so pending IDs are never evicted
+
+typedef enum {
+	CACHE_MISS = 0,		// Unknown test_id: run the command
+	CACHE_PENDING,		// Queued or running: its result will be sent when done
+	CACHE_DONE			// Completed: answer with the cached result
+} CacheState;
+
+// Controllers number their tests independently, so an entry belongs to a test_id and its sender
+typedef struct cache_entry_t {
+	uint32_t test_id;
+	uint32_t reply_addr;		// IPv4 address of the sender, as the caller keeps it
+	uint16_t reply_port;
+	CacheState state;
+	Result result;
+} cache_entry_t;
+
+// Recently seen commands of one UUT, oldest entries replaced first
+typedef struct cache_table_t {
+	cache_entry_t entries[RESULT_CACHE_SIZE];
+	uint8_t next_slot;
+} cache_table_t;
+
+CacheState cache_table_check(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port, result_pro_t *result);
+void cache_table_pending(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port);
+void cache_table_complete(cache_table_t *table, result_pro_t result, uint32_t addr, uint16_t port);
+void cache_table_forget(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port);
+
+#endif /* CACHE_TABLE_H_ */
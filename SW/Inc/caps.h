@@ -0,0 +1,31 @@
+#ifndef CAPS_H_
+#define CAPS_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <netinet/in.h>
+
+#include "project_header.h"
+#include "pipeline.h"
+#include "tlv.h"
+
+#define CAPS_DEFAULT_TIMEOUT    300     // millis to wait for the capability replies per round
+#define CAPS_DEFAULT_RETRIES    2       // further rounds for the UUTs that did not answer
+
+// What became of the capability query of a UUT (caps_uut_t.state)
+#define CAPS_NO_REPLY           0       // Never answered: down, or firmware that drops the query
+#define CAPS_LEGACY             1       // Answered with a plain result: firmware older than TLV
+#define CAPS_REPORTED           2       // Answered with TLV_MSG_CAPS
+
+typedef struct caps_uut_t {
+    struct sockaddr_in addr;
+    int state;
+    tlv_caps_t caps;                // Valid when CAPS_REPORTED
+} caps_uut_t;
+
+int caps_query(int sockfd, caps_uut_t *uuts, size_t count, unsigned timeout_ms, unsigned retries);
+int caps_common(const caps_uut_t *uuts, size_t count, tlv_caps_t *common);
+int caps_apply(const tlv_caps_t *caps, pipeline_config_t *cfg, test_command_t *commands, size_t count);
+void caps_print(FILE *out, const caps_uut_t *uut);
+
+#endif /* CAPS_H_ */
@@ -0,0 +1,56 @@
+#ifndef CMD_POOL_H_
+#define CMD_POOL_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+
+#define CMD_POOL_SIZE 	(16 + 2) 	// TEST_QUEUE_SIZE + the running test and one preempting it
+
+// A queued command: read in place from its received pbuf, or copied into `copy`
+typedef struct cmd_desc_t {
+	struct pbuf *p;				// Received frame holding the command, NULL when copied
+	test_command_t *cmd;		// The command: p->payload or &copy
+	ip_addr_t reply_addr;		// Where the command came from - its result goes back there
+	u16_t reply_port;
+	uint8_t batched;			// 1 - came in a batch frame: the result may be coalesced with others
+	uint8_t priority;			// PRIORITY_DEFAULT unless a TLV command set it
+	uint32_t deadline;			// Tick count the test must start by, 0 - none
+	uint32_t queued_at;			// Tick count it was queued at (test_queue.c)
+	uint32_t seq;				// Arrival order among equal priorities and deadlines
+	uint32_t soak_iterations;	// Soak: iterations to run back to back, 0 - no limit
+	uint32_t soak_ms;			// Soak: millis to run back to back, 0 - no limit (both 0 - not a soak)
+	uint8_t running;			// 1 - perform_tests() started it (cmd_pool_start)
+	volatile uint8_t cancelled;	// 1 - cancelled: dropped when dequeued, stopped between iterations when running
+	struct cmd_desc_t *next;	// Free list link
+	test_command_t copy;		// Fallback block for commands that are not contiguous in one pbuf
+} cmd_desc_t;
+
+// A queued command dropped by cmd_pool_cancel(): its controller still waits for the result
+typedef struct cmd_cancelled_t {
+	uint32_t test_id;
+	ip_addr_t reply_addr;
+	u16_t reply_port;
+	uint8_t extended;			// 1 - EXTENDED_RESULT: answered with a result_ext_t
+} cmd_cancelled_t;
+
+typedef struct cmd_pool_stats_t {
+	uint32_t allocated;			// Descriptors handed out since boot
+	uint32_t exhausted;			// Allocations that found the pool empty
+	uint32_t copied;			// Commands that needed the fallback copy
+	uint32_t cancelled;			// Commands cancelled, queued or running
+	uint8_t in_use;
+	uint8_t high_water;			// Most descriptors in use at once
+} cmd_pool_stats_t;
+
+void cmd_pool_init(void);
+cmd_desc_t* cmd_pool_take(struct pbuf *p, u16_t offset);
+cmd_desc_t* cmd_pool_take_copy(const test_command_t *cmd);
+void cmd_pool_release(cmd_desc_t *desc);
+uint8_t cmd_pool_start(cmd_desc_t *desc);
+uint8_t cmd_pool_cancel(uint32_t test_id, const ip_addr_t *addr, u16_t port, cmd_cancelled_t *queued, uint8_t *queued_count);
+void cmd_pool_get_stats(cmd_pool_stats_t *stats);
+
+#endif /* CMD_POOL_H_ */
@@ -0,0 +1,56 @@
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <stddef.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "project_header.h"
+#include "pipeline.h"
+
+#define FLEET_MAX_UUTS  1024
+
+// One UUT of the fleet: its own socket and pipeline of commands
+typedef struct fleet_uut_t {
+    struct sockaddr_in addr;
+    int sockfd;
+    pipeline_t pipeline;
+    double finished;                // time_now() when its last command completed, 0 while running
+} fleet_uut_t;
+
+struct fleet_t;
+struct outcome_ring_t;
+
+// A network thread servicing UUTs [first, end) of the fleet
+typedef struct fleet_worker_t {
+    struct fleet_t *fleet;
+    size_t first;
+    size_t end;
+    const test_command_t *commands;
+    const unsigned *deadlines_ms;
+    size_t per_uut;
+    const pipeline_config_t *cfg;
+    int epfd;                       // -1 on a ring
+    uring_t *ring;                  // io_uring shared by the worker's UUTs, NULL - epoll and plain socket calls
+    struct outcome_ring_t *results; // To the logging thread
+    pthread_t thread;
+    int started;                    // 1 - runs on its own thread
+    int status;
+} fleet_worker_t;
+
+typedef struct fleet_t {
+    fleet_uut_t *uuts;
+    size_t count;
+    unsigned threads;               // Network threads to split the UUTs between, 0 - one per core
+    fleet_worker_t *workers;
+    size_t worker_count;
+    double started;
+} fleet_t;
+
+int fleet_load(fleet_t *fleet, const char *path);
+int fleet_run(fleet_t *fleet, const test_command_t *commands, const unsigned *deadlines_ms, size_t per_uut,
+              const pipeline_config_t *cfg, outcome_cb on_outcome, void *ctx);
+void fleet_report(const fleet_t *fleet, double elapsed);
+void fleet_free(fleet_t *fleet);
+
+#endif /* FLEET_H_ */
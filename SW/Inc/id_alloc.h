@@ -0,0 +1,24 @@
+#ifndef ID_ALLOC_H_
+#define ID_ALLOC_H_
+
+#include <stdint.h>
+
+#define ID_FILE         "calls_count.bin"
+#define ID_LEGACY_FILE  "calls_count.txt"   // Text counter of older clients, seeds a new ID_FILE
+
+#define ID_MAGIC        0x44495455u         // "UTID"
+#define ID_VERSION      1
+
+// Layout of the memory-mapped counter file
+typedef struct id_counter_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t last_id;                       // Last test ID handed out (0 - none yet)
+} id_counter_t;
+
+int id_alloc_open(const char *path, const char *legacy_path);
+uint32_t id_alloc_reserve(uint32_t count);
+uint32_t id_alloc_next(void);
+void id_alloc_close(void);
+
+#endif /* ID_ALLOC_H_ */
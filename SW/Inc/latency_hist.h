@@ -0,0 +1,35 @@
+#ifndef LATENCY_HIST_H_
+#define LATENCY_HIST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Log-linear (HDR style) histogram of nanosecond latencies: values below 2^HIST_SUB_BITS
+ * are counted exactly, above that every power of two is split into 2^(HIST_SUB_BITS-1)
+ * buckets, so any reported value is within 1/128 of the true one.
+ */
+#define HIST_SUB_BITS       8
+#define HIST_MAX_BITS       40              // Values are clamped to ~18 minutes
+#define HIST_HALF           (1u << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS        (HIST_HALF * (HIST_MAX_BITS - HIST_SUB_BITS + 2))
+
+typedef struct latency_hist_t {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} latency_hist_t;
+
+void hist_init(latency_hist_t *hist);
+void hist_record(latency_hist_t *hist, uint64_t value_ns);
+void hist_merge(latency_hist_t *into, const latency_hist_t *from);
+uint64_t hist_percentile(const latency_hist_t *hist, double percentile);
+
+void hist_print_header(FILE *out);
+void hist_print(FILE *out, const char *name, const latency_hist_t *hist);
+void hist_export_header(FILE *out);
+void hist_export(FILE *out, const char *name, const latency_hist_t *hist);
+
+#endif /* LATENCY_HIST_H_ */
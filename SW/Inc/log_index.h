@@ -0,0 +1,65 @@
+#ifndef LOG_INDEX_H_
+#define LOG_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "result_log.h"
+
+#define LOG_INDEX_SUFFIX        ".idx"      // test_id -> record
+#define LOG_TIME_INDEX_SUFFIX   ".tdx"      // time bucket -> records
+#define LOG_INDEX_MAGIC         0x58495455u // "UTIX"
+#define LOG_TIME_INDEX_MAGIC    0x58445455u // "UTDX"
+#define LOG_INDEX_VERSION       1
+#define LOG_INDEX_MIN_SLOTS     4096
+#define LOG_INDEX_MAX_LOAD      0.75        // Grow the ID table beyond this share of used slots
+#define LOG_INDEX_BUCKET_SEC    60          // Width of a time bucket
+#define LOG_INDEX_NO_RECORD     0xFFFFFFFFu
+
+typedef struct log_index_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t indexed;                       // Log records covered by the index
+    uint64_t slot_count;                    // Power of two
+    uint64_t used;
+} log_index_header_t;
+
+// One slot of the open addressing ID table, record LOG_INDEX_NO_RECORD when free
+typedef struct log_index_slot_t {
+    uint32_t test_id;
+    uint32_t record;
+} log_index_slot_t;
+
+typedef struct log_time_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int64_t base_bucket;                    // Bucket of the first record, older ones are counted in bucket 0
+    uint64_t bucket_count;
+} log_time_header_t;
+
+// Records sent within one bucket lie between first and last (the log is appended in rough time order)
+typedef struct log_time_bucket_t {
+    uint32_t first;
+    uint32_t last;
+} log_time_bucket_t;
+
+typedef struct log_index_t {
+    char id_path[512];
+    char time_path[512];
+    int id_fd;
+    int time_fd;
+    log_index_header_t *ids;                // Mapped ID table file
+    size_t ids_length;
+    log_time_header_t *times;               // Mapped time bucket file
+    size_t times_length;
+} log_index_t;
+
+int log_index_open(log_index_t *idx, const char *log_path);
+int log_index_update(log_index_t *idx, const result_log_map_t *view);
+size_t log_index_find(const log_index_t *idx, uint32_t test_id, size_t *records, size_t max_records);
+int log_index_range(const log_index_t *idx, int64_t from_us, int64_t to_us, size_t *first, size_t *last);
+void log_index_close(log_index_t *idx);
+
+#endif /* LOG_INDEX_H_ */
@@ -0,0 +1,44 @@
+#ifndef OUTCOME_QUEUE_H_
+#define OUTCOME_QUEUE_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+
+#define OUTCOME_RING_SIZE   4096    // outcomes buffered per network thread, power of two
+#define OUTCOME_CACHE_LINE  64
+
+/*
+ * Single producer, single consumer ring of outcomes: one network thread pushes, the logging
+ * thread pops. Head and tail live on their own cache lines so the two sides never share one
+ * they both write.
+ */
+typedef struct outcome_ring_t {
+    _Alignas(OUTCOME_CACHE_LINE) size_t head;   // Next slot to pop, written by the consumer
+    _Alignas(OUTCOME_CACHE_LINE) size_t tail;   // Next slot to push, written by the producer
+    int closed;                                 // 1 - the producer pushes no more
+    size_t full_waits;                          // Pushes that found the ring full (logging fell behind)
+    _Alignas(OUTCOME_CACHE_LINE) test_outcome_t slots[OUTCOME_RING_SIZE];
+} outcome_ring_t;
+
+// A logging thread draining one ring per network thread into the run's outcome callback
+typedef struct outcome_queue_t {
+    outcome_ring_t *rings;
+    size_t count;
+    outcome_cb sink;                // Called on the logging thread only, never concurrently
+    void *ctx;
+    pthread_t thread;
+    int running;
+    size_t logged;
+    size_t max_backlog;             // Most outcomes waiting at once
+    size_t full_waits;              // Sum over the rings, once stopped
+} outcome_queue_t;
+
+int outcome_queue_start(outcome_queue_t *queue, size_t producers, outcome_cb sink, void *ctx);
+outcome_ring_t *outcome_queue_ring(outcome_queue_t *queue, size_t producer);
+void outcome_ring_push(const test_outcome_t *outcome, void *ctx);
+void outcome_ring_close(outcome_ring_t *ring);
+int outcome_queue_stop(outcome_queue_t *queue);
+
+#endif /* OUTCOME_QUEUE_H_ */
@@ -0,0 +1,158 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "project_header.h"
+#include "uring.h"
+#include "tlv.h"
+
+#define PIPELINE_DEFAULT_WINDOW     8       // commands in flight (the UUT's test queue holds 16)
+#define PIPELINE_MAX_WINDOW         1024
+#define PIPELINE_DEFAULT_TIMEOUT    1000    // millis to wait for a result before the first resend
+#define PIPELINE_DEFAULT_RETRIES    4       // resends before a command times out (31 s with the default timeout)
+#define PIPELINE_MAX_BACKOFF        16000   // cap of the doubled waits between resends (millis), unless -t is longer
+#define PIPELINE_BATCH              64      // datagrams per sendmmsg()/recvmmsg()
+#define PIPELINE_CONTROL_LEN        256     // ancillary data buffer per datagram (timestamps)
+#define RESULT_FRAME_SIZE           (BATCH_HEADER_SIZE + RESULT_BATCH_MAX * sizeof(result_pro_t))  // largest reply
+
+// Kernel timestamping modes (pipeline_t.timestamping)
+#define TIMESTAMPS_OFF              0
+#define TIMESTAMPS_RX_ONLY          1       // SO_TIMESTAMPNS: kernel receive time, user space send time
+#define TIMESTAMPS_FULL             2       // SO_TIMESTAMPING: kernel send and receive times
+
+// How the pipeline runs, shared by every UUT of a fleet
+typedef struct pipeline_config_t {
+    unsigned window;                // Maximum number of commands in flight
+    unsigned timeout_ms;            // How long to wait for a result before resending
+    unsigned retries;               // Resends (with doubling waits) before giving up
+    int kernel_timestamps;          // 1 - also measure round trips with kernel timestamps
+    int batch_io;                   // 1 - send and receive PIPELINE_BATCH datagrams per syscall
+    int compact;                    // 1 - send only bit_pattern_length bytes of pattern (TEST_COMMAND_SIZE)
+    double rate;                    // Commands per second to offer, 0 - as fast as the window allows
+    int io_uring;                   // 1 - send and receive through io_uring (plain syscalls when unavailable)
+    unsigned frame_commands;        // Commands packed per COMMAND_BATCH_TAG datagram, 0 - one datagram each
+    int tlv;                        // 1 - send every command as a TLV_MSG_COMMAND frame (overrides frame_commands)
+    uint8_t priority;               // TLV commands: queue priority on the UUT, PRIORITY_DEFAULT - arrival order
+    uint32_t soak_iterations;       // TLV commands: soak for this many iterations, 0 - no limit
+    unsigned soak_ms;               // TLV commands: soak for this many millis, 0 - no limit (both 0 - no soak)
+} pipeline_config_t;
+
+/*
+ * The outcome of one command, handed to the caller once its result arrived (or never will).
+ */
+typedef struct test_outcome_t {
+    const test_command_t *command;  // The command this outcome belongs to
+    result_pro_t result;            // The UUT's reply (TEST_ERR when timed out)
+    struct timeval sent;            // Wall-clock time the command was sent at
+    double duration;                // Round trip time in seconds (monotonic clock)
+    double kernel_duration;         // Round trip between kernel timestamps, -1 when not measured
+    int timed_out;                  // 1 - no result arrived in time
+    int extended;                   // 1 - the UUT answered with a result_ext_t (EXTENDED_RESULT)
+    result_ext_t detail;            // Valid when extended
+    int soaked;                     // 1 - the UUT answered with a TLV_MSG_SOAK_RESULT
+    tlv_soak_result_t soak;         // Valid when soaked
+} test_outcome_t;
+
+typedef void (*outcome_cb)(const test_outcome_t *outcome, void *ctx);
+
+// One progress frame of a STREAM_PROGRESS command still in flight
+typedef struct test_progress_t {
+    const test_command_t *command;
+    uint8_t iterations;             // Iterations the test runs
+    const progress_record_t *records;
+    size_t count;
+} test_progress_t;
+
+typedef void (*progress_cb)(const test_progress_t *progress, void *ctx);
+
+// A command waiting for its result, kept in an open addressing table keyed by test_id
+typedef struct inflight_t {
+    uint32_t test_id;
+    uint32_t index;                 // Position of the command in the pipeline's command list
+    struct timeval sent;            // Wall clock, for the log only
+    double sent_at;                 // time_now() at send
+    double deadline;                // time_now() based
+    uint32_t tx_seq;                // Send counter the kernel reports with the send timestamp
+    struct timespec tx_kernel;      // Kernel send timestamp of the last send (zero until it arrived)
+    double give_up;                 // time_now() based per test deadline, 0 - none
+    uint8_t attempts;               // Resends so far
+    uint8_t used;
+} inflight_t;
+
+// Message vectors of the batched (sendmmsg/recvmmsg) path, private to pipeline.c
+typedef struct pipeline_batch_t pipeline_batch_t;
+
+typedef struct pipeline_t {
+    int sockfd;
+    struct sockaddr_in uut;
+    const test_command_t *commands;
+    const unsigned *deadlines_ms;   // Per command limit including resends (0 - none), may be NULL
+    size_t count;
+    size_t next;                    // Next command to send
+    size_t completed;
+    unsigned window;
+    unsigned in_flight;
+    unsigned timeout_ms;
+    unsigned retries;
+    int compact;
+    unsigned frame_commands;        // 0 - one datagram per command
+    unsigned char *frame;           // Batch or TLV frame being built, BATCH_FRAME_MAX bytes
+    int tlv;                        // 1 - commands go out as TLV frames, one per datagram
+    uint8_t priority;               // TLV frames carry it, and the deadlines, to the UUT's queue
+    uint32_t soak_iterations;       // TLV frames carry the soak limits too
+    unsigned soak_ms;
+    double rate;
+    double next_send_at;            // time_now() the next paced command is due at, 0 before the first
+
+    int timestamping;               // TIMESTAMPS_* mode in effect on the socket
+    uint32_t tx_seq;                // Datagrams sent on the socket so far
+
+    inflight_t *table;
+    unsigned table_mask;
+    pipeline_batch_t *batch;        // NULL - one datagram per syscall
+    uring_t *ring;                  // NULL - plain socket calls
+    int own_ring;                   // 1 - the ring was created for this pipeline alone
+    struct msghdr ring_msg;         // Template of the multishot receive
+
+    outcome_cb on_outcome;
+    progress_cb on_progress;        // NULL - progress frames only keep their command from being resent
+    void *ctx;
+
+    // Statistics
+    size_t passed;
+    size_t failed;
+    size_t errors;
+    size_t timeouts;
+    size_t retransmits;
+    size_t stray;                   // Replies that did not match a command in flight
+    size_t progress_frames;         // PROGRESS_TAG frames received
+    size_t syscalls;                // Socket and poll calls made
+    size_t bytes_sent;              // Command bytes sent, resends included
+} pipeline_t;
+
+void pipeline_config_default(pipeline_config_t *cfg);
+int pipeline_init(pipeline_t *pl, int sockfd, const struct sockaddr_in *uut,
+                  const test_command_t *commands, size_t count,
+                  const pipeline_config_t *cfg, outcome_cb on_outcome, void *ctx);
+void pipeline_set_deadlines(pipeline_t *pl, const unsigned *deadlines_ms);
+void pipeline_set_progress(pipeline_t *pl, progress_cb on_progress);
+int pipeline_use_ring(pipeline_t *pl, uring_t *ring);
+int pipeline_reap(uring_t *ring);
+void pipeline_free(pipeline_t *pl);
+int pipeline_fill(pipeline_t *pl);
+int pipeline_drain(pipeline_t *pl);
+void pipeline_expire(pipeline_t *pl, double now);
+int pipeline_next_timeout(const pipeline_t *pl, double now);
+int pipeline_done(const pipeline_t *pl);
+int pipeline_run(pipeline_t *pl);
+
+double time_now(void);
+int parse_address(const char *text, struct sockaddr_in *addr);
+
+#endif /* PIPELINE_H_ */
@@ -8,12 +8,14 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stddef.h>
 
 
 //#define SERVER_IP "127.0.0.1"
 //#define g_server_port 8080
 #define CLIENT_IP "192.168.1.168"
 #define CLIENT_PORT 5005
+#define SERVER_PORT 8080
 
 #define MAX_BIT_PATTERN_LENGTH  256
 
@@ -24,6 +26,11 @@ typedef uint8_t Peripheral;
 #define SPI    4
 #define I2C    8
 #define ADC_P  16
+#define PERIPHERAL_MASK     0x1F    // The peripheral bits, the rest are option flags
+
+// Option flags in the high bits of test_command_t.peripheral
+#define STREAM_PROGRESS     0x80    // Stream progress frames while the test runs (test_monitor.h)
+#define EXTENDED_RESULT     0x40    // Answer with a result_ext_t instead of the plain result_pro_t
 
 #pragma pack(1)  // Disable padding
 typedef struct test_command_t {
@@ -35,6 +42,11 @@ typedef struct test_command_t {
 } test_command_t;
 #pragma pack()  // Restore default packing
 
+// Compact encoding: the header followed by only bit_pattern_length bytes of pattern.
+// A full sizeof(test_command_t) datagram is the same header with the whole array, so both are accepted.
+#define TEST_COMMAND_HEADER_SIZE    offsetof(test_command_t, bit_pattern)    // 7 bytes
+#define TEST_COMMAND_SIZE(cmd)      (TEST_COMMAND_HEADER_SIZE + (cmd)->bit_pattern_length)
+
 typedef enum {
 	TEST_ERR = -1,
 	TEST_PASS = 1,
@@ -48,6 +60,75 @@ typedef struct result_pro_t {
 } result_pro_t;
 #pragma pack()  // Restore default packing
 
+// Batch frames: several commands (or results) in one datagram. A frame starts with a tag where a
+// plain command or result has its test_id - test IDs from BATCH_TAG_FIRST up are never allocated.
+#define BATCH_TAG_FIRST         0xFFFFFF00u
+#define COMMAND_BATCH_TAG       0xFFFFFF01u     // followed by `count` compact commands back to back
+#define RESULT_BATCH_TAG        0xFFFFFF02u     // followed by `count` result_pro_t
+#define COMMAND_BATCH_MAX       16              // TEST_QUEUE_SIZE
+#define RESULT_BATCH_MAX        32
+#define BATCH_FRAME_MAX         1472            // UDP payload of one Ethernet frame
+
+#pragma pack(1)  // Disable padding
+typedef struct batch_header_t {
+    uint32_t tag;                   // 4 bytes: COMMAND_BATCH_TAG/RESULT_BATCH_TAG
+    uint8_t count;                  // 1 byte: Commands or results that follow
+} batch_header_t;
+#pragma pack()  // Restore default packing
+
+#define BATCH_HEADER_SIZE       sizeof(batch_header_t)     // 5 bytes
+
+// Progress frames of a STREAM_PROGRESS test: a batch header with PROGRESS_TAG, the test and
+// `count` records, sent every PROGRESS_INTERVAL_MS while it runs and before its result.
+#define PROGRESS_TAG            0xFFFFFF03u
+#define PROGRESS_RECORDS_MAX    32
+#define PROGRESS_INTERVAL_MS    100             // Longest a progress record waits for its datagram
+#define PROGRESS_PASSED         1
+#define PROGRESS_FAILED         0
+
+#pragma pack(1)  // Disable padding
+typedef struct progress_header_t {
+    batch_header_t batch;           // 5 bytes: PROGRESS_TAG and the number of records
+    uint32_t test_id;               // 4 bytes: The running test
+    uint8_t iterations;             // 1 byte: Iterations the test runs
+} progress_header_t;
+
+typedef struct progress_record_t {
+    uint8_t iteration;              // 1 byte: Index of the finished iteration (from 0)
+    uint8_t status;                 // 1 byte: PROGRESS_PASSED/PROGRESS_FAILED
+    uint32_t elapsed_us;            // 4 bytes: Since the test started
+} progress_record_t;
+#pragma pack()  // Restore default packing
+
+// Extended result of an EXTENDED_RESULT command: where and how the test failed, and how long its
+// transfers took. Told apart from a result_pro_t by the tag in place of the test_id.
+// A resend answered from the result cache gets the plain result_pro_t.
+#define RESULT_EXT_TAG          0xFFFFFF04u
+
+#define FAILURE_NONE            0
+#define FAILURE_TIMEOUT         1               // A transfer did not complete in time
+#define FAILURE_DATA            2               // The data came back different
+#define FAILURE_PERIPHERAL      3               // A HAL call failed
+#define FAILURE_INVALID         4               // The command could not be run (TEST_ERR)
+#define FAILURE_CANCELLED       5               // Cancelled before or while it ran (TEST_ERR)
+#define FAILURE_EXPIRED         6               // Its deadline passed while it was queued (TEST_ERR)
+
+#pragma pack(1)  // Disable padding
+typedef struct result_ext_t {
+    uint32_t tag;                   // 4 bytes: RESULT_EXT_TAG
+    uint32_t test_id;               // 4 bytes: Test-ID
+    int16_t test_result;            // 2 bytes: Result (TEST_PASS/TEST_FAIL/TEST_ERR)
+    uint8_t failure;                // 1 byte: FAILURE_* kind
+    uint8_t iterations_passed;      // 1 byte: Also the index of the failed iteration
+    uint16_t mismatch_offset;       // 2 bytes: First byte that differed (FAILURE_DATA)
+    uint8_t expected;               // 1 byte: Its value as sent
+    uint8_t actual;                 // 1 byte: Its value as received
+    uint32_t min_us;                // 4 bytes: Transfer time of the passed iterations
+    uint32_t avg_us;                // 4 bytes
+    uint32_t max_us;                // 4 bytes
+} result_ext_t;
+#pragma pack()  // Restore default packing
+
 uint32_t calculate_crc(uint8_t *data, size_t length);
 
 #endif
@@ -0,0 +1,18 @@
+#ifndef RESULT_AGG_H_
+#define RESULT_AGG_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+#include "lwip/ip_addr.h"
+
+#define RESULT_AGG_TIMEOUT_MS 	10 	// Longest a result waits for others to share its datagram
+
+typedef int (*result_send_fn)(const void *data, u16_t length, const ip_addr_t *addr, u16_t port);
+
+void result_agg_init(result_send_fn send);
+void result_agg_add(result_pro_t result, const ip_addr_t *addr, u16_t port);
+uint8_t result_agg_due(void);
+void result_agg_flush(void);
+
+#endif /* RESULT_AGG_H_ */
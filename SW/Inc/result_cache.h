@@ -0,0 +1,15 @@
+#ifndef RESULT_CACHE_H_
+#define RESULT_CACHE_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+#include "cache_table.h"
+#include "lwip/ip_addr.h"
+
+CacheState result_cache_check(uint32_t test_id, const ip_addr_t *addr, u16_t port, result_pro_t *result);
+void result_cache_pending(uint32_t test_id, const ip_addr_t *addr, u16_t port);
+void result_cache_complete(result_pro_t result, const ip_addr_t *addr, u16_t port);
+void result_cache_forget(uint32_t test_id, const ip_addr_t *addr, u16_t port);
+
+#endif /* RESULT_CACHE_H_ */
@@ -0,0 +1,76 @@
+#ifndef RESULT_LOG_H_
+#define RESULT_LOG_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "project_header.h"
+#include "pipeline.h"
+
+#define RESULT_LOG_FILE     "testing_log.bin"
+#define RESULT_LOG_MAGIC    0x474C5455u     // "UTLG"
+#define RESULT_LOG_VERSION  1
+#define RESULT_LOG_BATCH    512             // Records buffered before they are written at once
+
+// Text table of testing_log.txt, shared by logging() and the exporter
+#define LOG_HEADER_FORMAT   "%-9s %-25s %-15s %s\n"
+#define LOG_LINE_FORMAT     "%-9u %-25s %-15s %f\n"
+#define LOG_TIME_FORMAT     "%d-%m-%Y %H:%M:%S"
+
+#define RECORD_TIMED_OUT    0x01            // result_record_t.flags: no reply arrived
+
+#define PERIPHERAL_COUNT    5               // TIMER, UART, SPI, I2C, ADC_P
+
+#pragma pack(1)  // Disable padding
+typedef struct result_log_header_t {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint8_t reserved[8];
+} result_log_header_t;
+
+typedef struct result_record_t {
+    uint32_t test_id;                       // 4 bytes: Test-ID
+    int64_t sent_us;                        // 8 bytes: Send time, micros since the epoch
+    uint32_t duration_us;                   // 4 bytes: Round trip time
+    int32_t result;                         // 4 bytes: Result (TEST_PASS/TEST_FAIL/TEST_ERR)
+    Peripheral peripheral;                  // 1 byte: Tested peripheral
+    uint8_t pattern_length;                 // 1 byte: Length of bit pattern
+    uint8_t flags;                          // 1 byte: RECORD_* flags
+    uint8_t reserved;
+} result_record_t;
+#pragma pack()  // Restore default packing
+
+// Buffered writer, appends whole batches of records with one write()
+typedef struct result_log_t {
+    int fd;
+    size_t used;
+    result_record_t buffer[RESULT_LOG_BATCH];
+} result_log_t;
+
+// Read-only view of a whole log file
+typedef struct result_log_map_t {
+    void *map;
+    size_t length;
+    const result_record_t *records;
+    size_t count;
+} result_log_map_t;
+
+int result_log_open(result_log_t *log, const char *path);
+int result_log_append(result_log_t *log, const test_outcome_t *outcome);
+int result_log_flush(result_log_t *log);
+int result_log_close(result_log_t *log);
+
+int result_log_map(result_log_map_t *view, const char *path);
+void result_log_unmap(result_log_map_t *view);
+
+const char *result_name(int32_t result);
+int peripheral_slot(Peripheral peripheral);
+Peripheral peripheral_at(int slot);
+const char *peripheral_name(Peripheral peripheral);
+Peripheral peripheral_by_name(const char *name);
+void result_log_print_header(FILE *out);
+void result_log_print_record(FILE *out, const result_record_t *record);
+
+#endif /* RESULT_LOG_H_ */
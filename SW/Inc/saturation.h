@@ -0,0 +1,27 @@
+#ifndef SATURATION_H_
+#define SATURATION_H_
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "project_header.h"
+#include "pipeline.h"
+
+#define SATURATION_DEFAULT_SECONDS  2.0
+#define SATURATION_MAX_STEPS        64
+#define SATURATION_LOSS_LIMIT       1.0     // % rejected or late a step may have below the knee
+#define SATURATION_RATE_LIMIT       95.0    // % of the offered rate a step must achieve below the knee
+
+// Offered rate ramp: start, start + step, ... up to max commands per second
+typedef struct saturation_config_t {
+    double start_rate;
+    double step_rate;
+    double max_rate;
+    double step_seconds;            // How long every rate is offered
+} saturation_config_t;
+
+int saturation_parse(const char *text, saturation_config_t *sat);
+int saturation_run(int sockfd, const struct sockaddr_in *uut, const test_command_t *templates, size_t template_count,
+                   const saturation_config_t *sat, const pipeline_config_t *cfg);
+
+#endif /* SATURATION_H_ */
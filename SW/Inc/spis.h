@@ -10,6 +10,7 @@
 #include "stm32f7xx_hal.h" // General HAL header, often includes peripheral specific ones
 
 #include "project_header.h"
+#include "test_monitor.h"
 
 #define TIMEOUT 	1000 	// ticks (60  millis).
 
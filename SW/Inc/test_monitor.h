@@ -0,0 +1,28 @@
+#ifndef TEST_MONITOR_H_
+#define TEST_MONITOR_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+#include "result_agg.h"
+#include "cmd_pool.h"
+#include "lwip/ip_addr.h"
+
+// Runs commands that preempt the test at its iteration boundaries
+typedef void (*checkpoint_fn)(const cmd_desc_t *running);
+
+void test_monitor_init(result_send_fn send, checkpoint_fn checkpoint);
+void test_monitor_begin(const cmd_desc_t *desc);
+uint8_t test_monitor_checkpoint(void);
+void test_monitor_iteration_start(void);
+void test_monitor_iteration(uint8_t iteration);
+void test_monitor_pace(void);
+uint8_t test_monitor_iterations(void);
+void test_monitor_timeout(void);
+void test_monitor_mismatch(const uint8_t *expected, const uint8_t *actual, uint16_t length);
+void test_monitor_value(uint16_t offset, uint8_t expected, uint8_t actual);
+void test_monitor_end(Result result);
+void test_monitor_result(result_ext_t *ext, result_pro_t result);
+uint32_t test_monitor_elapsed_us(void);
+
+#endif /* TEST_MONITOR_H_ */
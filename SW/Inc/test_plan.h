@@ -0,0 +1,45 @@
+#ifndef TEST_PLAN_H_
+#define TEST_PLAN_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "project_header.h"
+#include "pipeline.h"
+
+#define PLAN_MAX_TESTS      4096
+#define PLAN_MAX_PATTERN    255             // bit_pattern_length is one byte
+
+/*
+ * One line of a plan file:
+ *   PERIPHERAL ITERATIONS [PATTERN | @GENERATOR] [deadline=MILLIS]
+ * PATTERN is sent like the command line pattern (a string, may be "quoted").
+ * Generators build a binary pattern of N bytes:
+ *   @random:N[:SEED]  @counter:N  @fill:N:BYTE  @walk:N (walking ones)
+ */
+typedef struct plan_entry_t {
+    test_command_t command;         // test_id is assigned when the plan runs
+    unsigned deadline_ms;           // 0 - only the resend limit applies
+    int line;
+    char pattern_text[32];          // Pattern as written in the plan, for the report
+
+    // Outcomes of this entry
+    size_t passed;
+    size_t failed;
+    size_t errors;
+    size_t timeouts;
+    double duration_sum;
+    double duration_max;
+} plan_entry_t;
+
+typedef struct test_plan_t {
+    plan_entry_t *entries;
+    size_t count;
+} test_plan_t;
+
+int plan_load(test_plan_t *plan, const char *path);
+void plan_record(test_plan_t *plan, size_t entry, const test_outcome_t *outcome);
+void plan_report(FILE *out, const test_plan_t *plan, double elapsed);
+void plan_free(test_plan_t *plan);
+
+#endif /* TEST_PLAN_H_ */
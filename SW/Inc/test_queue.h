@@ -0,0 +1,21 @@
+#ifndef TEST_QUEUE_H_
+#define TEST_QUEUE_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cmd_pool.h"
+#include "tlv.h"
+
+#define TEST_QUEUE_SIZE 	16 	// Commands waiting to run
+
+void test_queue_init(TaskHandle_t consumer);
+uint8_t test_queue_push(cmd_desc_t *desc);
+cmd_desc_t* test_queue_pop(void);
+cmd_desc_t* test_queue_pop_above(const cmd_desc_t *running);
+cmd_desc_t* test_queue_take_expired(void);
+uint8_t test_queue_depth(void);
+void test_queue_get_stats(tlv_queue_stats_t *stats);
+
+#endif /* TEST_QUEUE_H_ */
@@ -0,0 +1,164 @@
+#ifndef TLV_H_
+#define TLV_H_
+
+#include <stdint.h>
+
+#include "project_header.h"
+
+// Versioned type-length-value frames, shared by the UUT firmware and the host tools.
+// A frame starts with TLV_TAG where a plain command has its test_id, then a header with the
+// sender's protocol version and message type, then the TLVs (type, length, value).
+#define TLV_TAG                 0xFFFFFF05u
+#define PROTOCOL_VERSION        1
+#define TLV_FRAME_MAX           BATCH_FRAME_MAX
+#define TLV_BUILD_ID_MAX        32
+
+// Message types
+#define TLV_MSG_CAPS_QUERY      1       // Capability query, no TLVs
+#define TLV_MSG_CAPS            2       // Capability reply
+#define TLV_MSG_COMMAND         3       // One test command, answered like a plain one
+#define TLV_MSG_CANCEL          4       // Cancel a queued or running test of the sender, TLV_TEST_ID 0 (or none) - all of them
+#define TLV_MSG_CANCELLED       5       // Reply to TLV_MSG_CANCEL
+#define TLV_MSG_STATS_QUERY     6       // Queue statistics query, no TLVs
+#define TLV_MSG_STATS           7       // Queue statistics reply
+#define TLV_MSG_SOAK_RESULT     8       // Result of a soak command, instead of result_pro_t/result_ext_t
+#define TLV_MSG_ERROR           9       // Refusal of a malformed frame or of a message type the UUT does not know
+
+// TLVs of TLV_MSG_COMMAND
+#define TLV_TEST_ID             1       // uint32_t
+#define TLV_PERIPHERAL          2       // uint8_t: Peripheral bit
+#define TLV_ITERATIONS          3       // uint8_t
+#define TLV_PATTERN             4       // Bit pattern bytes
+#define TLV_OPTIONS             5       // uint8_t: STREAM_PROGRESS/EXTENDED_RESULT flags
+#define TLV_PRIORITY            7       // uint8_t: Higher runs first, preempting lower ones at iteration boundaries
+#define TLV_DEADLINE            8       // uint32_t: Millis after arrival the test must start by, else TEST_ERR
+#define TLV_SOAK_ITERATIONS     9       // uint32_t: Soak - iterations to run back to back (TLV_ITERATIONS is ignored)
+#define TLV_SOAK_DURATION       10      // uint32_t: Soak - millis to run back to back, the first limit reached ends it
+
+// TLVs of TLV_MSG_CANCEL (and TLV_TEST_ID)
+#define TLV_CONTROLLER_PORT     15      // uint16_t: Port the cancelled tests were sent from, 0 - any port of the
+                                        // sender's address; none - the port of the cancel itself
+
+// TLVs of TLV_MSG_CANCELLED (and TLV_TEST_ID as in the cancel)
+#define TLV_CANCEL_COUNT        6       // uint16_t: Tests cancelled, queued and running
+
+// TLVs of TLV_MSG_SOAK_RESULT (and TLV_TEST_ID)
+#define TLV_RESULT              11      // int16_t: TEST_PASS, TEST_FAIL if an iteration failed, TEST_ERR
+#define TLV_SOAK_PASSED         12      // uint32_t: Iterations passed
+#define TLV_SOAK_FAILED         13      // uint32_t: Iterations failed
+#define TLV_SOAK_ELAPSED        14      // uint32_t: Millis the soak ran
+
+// TLVs of TLV_MSG_ERROR
+#define TLV_ERROR_CODE          23      // uint8_t: TLV_ERR_*
+#define TLV_ERROR_TYPE          24      // uint8_t: Message type of the refused frame, 0 if unreadable
+
+// TLV_ERROR_CODE values
+#define TLV_ERR_MALFORMED       1       // The frame could not be decoded
+#define TLV_ERR_UNSUPPORTED     2       // A message type added by a newer protocol version
+
+// TLVs of TLV_MSG_CAPS
+#define TLV_CAP_VERSION         16      // uint8_t: Highest protocol version understood
+#define TLV_CAP_PERIPHERALS     17      // uint8_t: Peripheral bits that can be tested
+#define TLV_CAP_MAX_PATTERN     18      // uint16_t: Longest bit pattern
+#define TLV_CAP_MAX_BATCH       19      // uint8_t: Commands per COMMAND_BATCH_TAG frame
+#define TLV_CAP_RESULT_BATCH    20      // uint8_t: Results per RESULT_BATCH_TAG frame
+#define TLV_CAP_FEATURES        21      // uint32_t: FEATURE_* bits
+#define TLV_CAP_BUILD_ID        22      // Firmware build ID, not terminated
+
+// TLV_CAP_FEATURES bits
+#define FEATURE_COMPACT         0x01    // TEST_COMMAND_SIZE commands
+#define FEATURE_BATCH_FRAMES    0x02    // COMMAND_BATCH_TAG frames, RESULT_BATCH_TAG replies
+#define FEATURE_PROGRESS        0x04    // STREAM_PROGRESS
+#define FEATURE_EXTENDED_RESULT 0x08    // EXTENDED_RESULT
+#define FEATURE_TLV_COMMAND     0x10    // TLV_MSG_COMMAND
+#define FEATURE_CANCEL          0x20    // TLV_MSG_CANCEL
+#define FEATURE_PRIORITY        0x40    // TLV_PRIORITY, TLV_DEADLINE and TLV_MSG_STATS
+#define FEATURE_SOAK            0x80    // TLV_SOAK_ITERATIONS, TLV_SOAK_DURATION and TLV_MSG_SOAK_RESULT
+
+// TLVs of TLV_MSG_STATS
+#define TLV_STAT_DEPTH          32      // uint8_t: Commands queued now
+#define TLV_STAT_HIGH_WATER     33      // uint8_t: Most commands queued at once
+#define TLV_STAT_QUEUED         34      // uint32_t: Commands queued since boot
+#define TLV_STAT_REJECTED       35      // uint32_t: Commands refused with a full queue
+#define TLV_STAT_EXPIRED        36      // uint32_t: Commands whose deadline passed before they ran
+#define TLV_STAT_PREEMPTED      37      // uint32_t: Commands run at an iteration boundary of a lower priority test
+#define TLV_STAT_WAIT_AVG       38      // uint32_t: Average millis from arrival to start
+#define TLV_STAT_WAIT_MAX       39      // uint32_t: Longest millis from arrival to start
+#define TLV_STAT_POOL_HIGH      40      // uint8_t: Most command descriptors in use at once
+#define TLV_STAT_POOL_EXHAUSTED 41      // uint32_t: Commands refused because no descriptor was free
+#define TLV_STAT_POOL_COPIED    42      // uint32_t: Commands copied out of a fragmented frame
+
+#pragma pack(1)  // Disable padding
+typedef struct tlv_header_t {
+    uint32_t tag;                   // 4 bytes: TLV_TAG
+    uint8_t zero;                   // 1 byte: 0 - firmware older than TLV reads the peripheral here and refuses the frame
+    uint8_t version;                // 1 byte: PROTOCOL_VERSION of the sender
+    uint8_t type;                   // 1 byte: TLV_MSG_*
+    uint16_t length;                // 2 bytes: TLV bytes that follow
+} tlv_header_t;
+#pragma pack()  // Restore default packing
+
+#define TLV_HEADER_SIZE         sizeof(tlv_header_t)    // 9 bytes
+#define TLV_ITEM_HEADER_SIZE    3                       // type (1 byte) and length (2 bytes)
+
+#define PRIORITY_DEFAULT        0       // Plain commands and TLV commands without TLV_PRIORITY
+
+// How a TLV command is scheduled, and how long it soaks
+typedef struct tlv_sched_t {
+    uint8_t priority;
+    uint32_t deadline_ms;           // 0 - none
+    uint32_t soak_iterations;       // 0 - no limit
+    uint32_t soak_ms;               // 0 - no limit, both 0 - not a soak
+} tlv_sched_t;
+
+// What a soak command reports once it ends
+typedef struct tlv_soak_result_t {
+    uint32_t test_id;
+    int16_t result;                 // Result, as wide as result_pro_t.test_result
+    uint32_t passed;
+    uint32_t failed;
+    uint32_t elapsed_ms;
+} tlv_soak_result_t;
+
+// Queue statistics of a TLV_MSG_STATS
+typedef struct tlv_queue_stats_t {
+    uint8_t depth;
+    uint8_t high_water;
+    uint32_t queued;
+    uint32_t rejected;
+    uint32_t expired;
+    uint32_t preempted;
+    uint32_t wait_avg_ms;
+    uint32_t wait_max_ms;
+    uint8_t pool_high_water;        // Command descriptor pool, 0 - not reported
+    uint32_t pool_exhausted;
+    uint32_t pool_copied;
+} tlv_queue_stats_t;
+
+// What a UUT supports, from its TLV_MSG_CAPS reply
+typedef struct tlv_caps_t {
+    uint8_t version;
+    uint8_t peripherals;
+    uint16_t max_pattern;
+    uint8_t max_batch;
+    uint8_t result_batch;
+    uint32_t features;
+    char build_id[TLV_BUILD_ID_MAX + 1];
+} tlv_caps_t;
+
+uint16_t tlv_encode_query(void *frame, uint16_t size, uint8_t type);
+uint16_t tlv_encode_caps(void *frame, uint16_t size, const tlv_caps_t *caps);
+uint16_t tlv_encode_command(void *frame, uint16_t size, const test_command_t *cmd, const tlv_sched_t *sched);
+int tlv_message_type(const void *frame, uint16_t size);
+int tlv_decode_caps(const void *frame, uint16_t size, tlv_caps_t *caps);
+int tlv_decode_command(const void *frame, uint16_t size, test_command_t *cmd, tlv_sched_t *sched);
+uint16_t tlv_encode_cancel(void *frame, uint16_t size, uint8_t type, uint32_t test_id, uint16_t port, uint16_t count);
+int tlv_decode_cancel(const void *frame, uint16_t size, uint8_t type, uint32_t *test_id, uint16_t *port, uint16_t *count);
+uint16_t tlv_encode_stats(void *frame, uint16_t size, const tlv_queue_stats_t *stats);
+int tlv_decode_stats(const void *frame, uint16_t size, tlv_queue_stats_t *stats);
+uint16_t tlv_encode_soak_result(void *frame, uint16_t size, const tlv_soak_result_t *soak);
+int tlv_decode_soak_result(const void *frame, uint16_t size, tlv_soak_result_t *soak);
+uint16_t tlv_encode_error(void *frame, uint16_t size, uint8_t code, uint8_t refused_type);
+int tlv_decode_error(const void *frame, uint16_t size, uint8_t *code, uint8_t *refused_type);
+
+#endif /* TLV_H_ */
@@ -11,6 +11,7 @@
 #include "stm32f7xx_hal_uart.h" // Specifically for UART_HandleTypeDef and HAL_UART functions
 
 #include "project_header.h"
+#include "test_monitor.h"
 
 #define TIMEOUT 	1000 	// ticks (30  millis).
 
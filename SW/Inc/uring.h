@@ -0,0 +1,61 @@
+#ifndef URING_H_
+#define URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES       256     // submission queue entries (the completion queue holds 4x as many)
+#define URING_BUFFERS       512     // receive buffers handed to the kernel, power of two
+#define URING_BUFFER_SIZE   512     // io_uring_recvmsg_out, source address and one datagram (up to a result frame)
+#define URING_BUFFER_GROUP  0
+#define URING_TIMER         0       // user_data of the wait timeouts
+
+/*
+ * An io_uring instance driven through the raw system calls (no liburing), plus a ring of
+ * provided buffers that multishot receives pick their buffers from.
+ */
+typedef struct uring_t {
+    int fd;
+
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;                 // Prepared entries, published on the next submit
+    struct io_uring_sqe *sqes;
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map;
+    size_t sq_map_length;
+    void *cq_map;                           // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_length;
+    size_t sqes_length;
+
+    // Provided receive buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_length;
+    unsigned char *buffers;
+    uint16_t buf_tail;
+
+    struct __kernel_timespec timeout;       // Read by the kernel when the timeout is submitted
+    size_t syscalls;                        // io_uring_enter() calls made
+} uring_t;
+
+uring_t *uring_create(unsigned entries);
+void uring_free(uring_t *ring);
+struct io_uring_sqe *uring_sqe(uring_t *ring);
+int uring_submit(uring_t *ring);
+int uring_wait(uring_t *ring, int timeout_ms);
+struct io_uring_cqe *uring_peek(uring_t *ring);
+void uring_seen(uring_t *ring);
+unsigned char *uring_buffer(uring_t *ring, unsigned bid);
+void uring_recycle(uring_t *ring, unsigned bid);
+
+#endif /* URING_H_ */
@@ -31,6 +31,7 @@ Result adc_testing(test_command_t* command){
     }
 
 	for(uint8_t i=0 ; i< command->iterations ; i++){
+		if (test_monitor_checkpoint()) return TEST_ERR;
 
 		if(i < command->bit_pattern_length){
 			// Extract the 8-bit expected ADC value from the command's bit pattern
@@ -42,6 +43,7 @@ Result adc_testing(test_command_t* command){
 	    // Set value to DAC and run
 	    HAL_DAC_SetValue(&hdac, DAC_CHANNEL_1, DAC_ALIGN_8B_R, expected_adc_result);
 	    HAL_Delay(1); // allow DAC to settle
+	    test_monitor_iteration_start();
 
 	    // Start ADC conversion
 	    status = HAL_ADC_Start_IT(&hadc1);
@@ -58,6 +60,7 @@ Result adc_testing(test_command_t* command){
 		} // end of ADC conversion
 		else{
 //	         printf("ADC semaphore acquire failed or timed out\n\r"); // Debug printf
+	         test_monitor_timeout();
 	         HAL_ADC_Stop(&hadc1);
 	         return TEST_FAIL;
 		}
@@ -69,6 +72,7 @@ Result adc_testing(test_command_t* command){
 		if (difference > adc_tolerance)
 		{
 //			  printf("Test failed on iteration %u- Expected Value: %u, ADC value: %lu.\n\r",i+1, expected_adc_result, adc_value); // Debug printf
+			  test_monitor_value(i < command->bit_pattern_length ? i : 0, (uint8_t)expected_adc_result, (uint8_t)adc_value);
 			  HAL_ADC_Stop(&hadc1);
 			  return TEST_FAIL;
 //		} else {
@@ -82,6 +86,7 @@ Result adc_testing(test_command_t* command){
 //			printf("Warning: Failed to stop ADC conversion. Status: %d\n\r", status); // Debug printf
 	         return TEST_FAIL;
 		}
+		test_monitor_iteration(i);
 	} // end of iterations
 
 	return TEST_PASS;
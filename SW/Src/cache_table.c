@@ -0,0 +1,68 @@
+#include <stddef.h>
+
+#include "cache_table.h"
+/*
+ * The lookup and replacement rules of the result cache, without any locking.
+ * result_cache.c keeps the firmware's table behind critical sections; uut_emulator.c keeps
+ * one table per virtual UUT, so both answer resends the same way.
+ */
+
+static cache_entry_t* find_entry(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port){
+	for(uint8_t i=0 ; i< RESULT_CACHE_SIZE ; i++){
+		cache_entry_t *entry = &table->entries[i];
+		if (entry->state != CACHE_MISS && entry->test_id == test_id &&
+			entry->reply_addr == addr && entry->reply_port == port) return entry;
+	}
+	return NULL;
+}
+
+// Replaces the oldest entry that is not pending
+static cache_entry_t* new_entry(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port){
+	for(uint8_t i=0 ; i< RESULT_CACHE_SIZE ; i++){
+		cache_entry_t *entry = &table->entries[table->next_slot];
+		table->next_slot = (table->next_slot + 1) % RESULT_CACHE_SIZE;
+		if (entry->state != CACHE_PENDING) {
+			entry->test_id = test_id;
+			entry->reply_addr = addr;
+			entry->reply_port = port;
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * @brief Looks up a received command by its test_id and sender.
+ * @param result: Set to the cached result when the test already completed.
+ * @retval CacheState: What to do with the command.
+ */
+CacheState cache_table_check(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port, result_pro_t *result){
+	cache_entry_t *entry = find_entry(table, test_id, addr, port);
+
+	if (entry == NULL) return CACHE_MISS;
+	result->test_id = test_id;
+	result->test_result = entry->result;
+	return entry->state;
+}
+
+// Marks a test_id as accepted, a resend arriving while it is queued or runs is then ignored
+void cache_table_pending(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port){
+	cache_entry_t *entry = new_entry(table, test_id, addr, port);
+	if (entry != NULL) entry->state = CACHE_PENDING;
+}
+
+// Stores the result of a completed test for later resends of its command
+void cache_table_complete(cache_table_t *table, result_pro_t result, uint32_t addr, uint16_t port){
+	cache_entry_t *entry = find_entry(table, result.test_id, addr, port);
+	if (entry == NULL) entry = new_entry(table, result.test_id, addr, port);
+	if (entry != NULL) {
+		entry->result = result.test_result;
+		entry->state = CACHE_DONE;
+	}
+}
+
+// Drops a pending test_id whose command could not be queued, so a resend runs it
+void cache_table_forget(cache_table_t *table, uint32_t test_id, uint32_t addr, uint16_t port){
+	cache_entry_t *entry = find_entry(table, test_id, addr, port);
+	if (entry != NULL && entry->state == CACHE_PENDING) entry->state = CACHE_MISS;
+}
@@ -0,0 +1,225 @@
+/**
+  * @brief Capability discovery: asks the UUTs what they support before a run
+  *
+  * Every UUT is sent a TLV_MSG_CAPS_QUERY. Firmware that knows TLV answers with its
+  * capabilities; older firmware reads the query as a command with no peripheral and answers
+  * it with a plain result, which marks it as legacy. The run then only uses the options
+  * every UUT supports, so a fleet can be upgraded one UUT at a time.
+  */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "caps.h"
+#include "result_log.h"
+
+static caps_uut_t *caps_find(caps_uut_t *uuts, size_t count, const struct sockaddr_in *from)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (uuts[i].addr.sin_addr.s_addr == from->sin_addr.s_addr && uuts[i].addr.sin_port == from->sin_port) {
+            return &uuts[i];
+        }
+    }
+    return NULL;
+}
+
+// Sends the query to every UUT that has not answered yet
+static int caps_send_queries(int sockfd, caps_uut_t *uuts, size_t count)
+{
+    unsigned char query[TLV_HEADER_SIZE];
+    uint16_t len = tlv_encode_query(query, sizeof(query), TLV_MSG_CAPS_QUERY);
+
+    for (size_t i = 0; i < count; i++) {
+        if (uuts[i].state != CAPS_NO_REPLY) continue;
+        while (sendto(sockfd, query, len, 0, (const struct sockaddr *)&uuts[i].addr, sizeof(uuts[i].addr)) < 0) {
+            if (errno == EINTR) continue;
+            perror("Error: Could not send the capability query");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Queries the capabilities of the UUTs, resending to those that stay silent.
+ * @param uuts: Addresses to query, their state and capabilities are filled in.
+ * @param timeout_ms: How long every round waits for the replies.
+ * @param retries: Further rounds for the UUTs that did not answer.
+ * @retval 0 on success (whatever the UUTs answered), -1 on a socket error.
+ */
+int caps_query(int sockfd, caps_uut_t *uuts, size_t count, unsigned timeout_ms, unsigned retries)
+{
+    unsigned char reply[RESULT_FRAME_SIZE];
+    size_t pending = count;
+
+    for (size_t i = 0; i < count; i++) uuts[i].state = CAPS_NO_REPLY;
+
+    for (unsigned round = 0; round <= retries && pending > 0; round++) {
+        if (caps_send_queries(sockfd, uuts, count) < 0) return -1;
+
+        double deadline = time_now() + timeout_ms / 1000.0;
+        while (pending > 0) {
+            int wait_ms = (int)((deadline - time_now()) * 1000);
+            if (wait_ms <= 0) break;
+
+            struct pollfd pfd = {.fd = sockfd, .events = POLLIN};
+            int ready = poll(&pfd, 1, wait_ms);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready < 0) {
+                perror("poll failed");
+                return -1;
+            }
+            if (ready == 0) break;
+
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(sockfd, reply, sizeof(reply), 0, (struct sockaddr *)&from, &from_len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                perror("recvfrom failed");
+                return -1;
+            }
+
+            caps_uut_t *uut = caps_find(uuts, count, &from);
+            if (uut == NULL || uut->state != CAPS_NO_REPLY) continue;   // Stray or repeated reply
+            // Anything but a capability reply answers the query as an ordinary command
+            if (tlv_message_type(reply, (uint16_t)n) == TLV_MSG_CAPS && tlv_decode_caps(reply, (uint16_t)n, &uut->caps) == 0) {
+                uut->state = CAPS_REPORTED;
+            }
+            else {
+                uut->state = CAPS_LEGACY;
+            }
+            pending--;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Capabilities shared by every UUT that reported them: the lowest limits and the
+ * features all of them have.
+ * @retval Number of UUTs that did not report their capabilities.
+ */
+int caps_common(const caps_uut_t *uuts, size_t count, tlv_caps_t *common)
+{
+    int missing = 0;
+    int first = 1;
+
+    memset(common, 0, sizeof(*common));
+    for (size_t i = 0; i < count; i++) {
+        const tlv_caps_t *caps = &uuts[i].caps;
+        if (uuts[i].state != CAPS_REPORTED) {
+            missing++;
+            continue;
+        }
+        if (first) {
+            *common = *caps;
+            first = 0;
+            continue;
+        }
+        if (caps->version < common->version) common->version = caps->version;
+        common->peripherals &= caps->peripherals;
+        if (caps->max_pattern < common->max_pattern) common->max_pattern = caps->max_pattern;
+        if (caps->max_batch < common->max_batch) common->max_batch = caps->max_batch;
+        if (caps->result_batch < common->result_batch) common->result_batch = caps->result_batch;
+        common->features &= caps->features;
+        if (strcmp(caps->build_id, common->build_id) != 0) strcpy(common->build_id, "mixed");
+    }
+    return missing;
+}
+
+/*
+ * @brief Turns off the options the UUTs do not support, with a notice for each.
+ * @param caps: What the UUTs support, NULL when one of them predates capability discovery
+ *              (the options are then used as given, except TLV commands).
+ * @param commands: Their STREAM_PROGRESS/EXTENDED_RESULT flags are cleared when unsupported.
+ * @retval 0 on success, -1 if a test needs a peripheral or pattern length the UUTs lack.
+ */
+int caps_apply(const tlv_caps_t *caps, pipeline_config_t *cfg, test_command_t *commands, size_t count)
+{
+    if (caps == NULL) {
+        if (cfg->tlv) printf("Not every UUT reported its capabilities, sending plain commands\n");
+        cfg->tlv = 0;
+        return 0;
+    }
+
+    if (cfg->tlv && !(caps->features & FEATURE_TLV_COMMAND)) {
+        printf("The UUT does not take TLV commands, sending plain ones\n");
+        cfg->tlv = 0;
+    }
+    if (cfg->tlv && cfg->priority != PRIORITY_DEFAULT && !(caps->features & FEATURE_PRIORITY)) {
+        // Older firmware skips the unknown TLV, the tests just run in arrival order
+        printf("The UUT does not schedule by priority, the tests run in arrival order\n");
+    }
+    if (cfg->tlv && (cfg->soak_iterations > 0 || cfg->soak_ms > 0) && !(caps->features & FEATURE_SOAK)) {
+        // The soak TLVs are skipped as well, every test then runs its own iteration count once
+        printf("The UUT does not soak, the tests run their iterations once\n");
+    }
+    if (cfg->compact && !(caps->features & FEATURE_COMPACT)) {
+        printf("The UUT does not take compact commands, sending whole ones\n");
+        cfg->compact = 0;
+    }
+    if (cfg->frame_commands > 0 && !(caps->features & FEATURE_BATCH_FRAMES)) {
+        printf("The UUT does not take command frames, sending one command per datagram\n");
+        cfg->frame_commands = 0;
+    }
+    else if (cfg->frame_commands > caps->max_batch && caps->max_batch > 0) {
+        printf("The UUT takes up to %u commands per frame\n", caps->max_batch);
+        cfg->frame_commands = caps->max_batch;
+    }
+
+    uint8_t strip = 0;
+    size_t stripped = 0, unsupported = 0;
+    if (!(caps->features & FEATURE_PROGRESS)) strip |= STREAM_PROGRESS;
+    if (!(caps->features & FEATURE_EXTENDED_RESULT)) strip |= EXTENDED_RESULT;
+    for (size_t i = 0; i < count; i++) {
+        if (commands[i].peripheral & strip) {
+            commands[i].peripheral &= ~strip;
+            stripped++;
+        }
+        if ((commands[i].peripheral & PERIPHERAL_MASK & ~caps->peripherals) != 0 ||
+            (caps->max_pattern > 0 && commands[i].bit_pattern_length > caps->max_pattern)) {
+            unsupported++;
+        }
+    }
+    if (stripped > 0) printf("%zu tests run without the progress or extended results the UUT does not support\n", stripped);
+    if (unsupported > 0) {
+        printf("%zu tests need a peripheral or pattern length the UUT does not support\n", unsupported);
+        return -1;
+    }
+    return 0;
+}
+
+void caps_print(FILE *out, const caps_uut_t *uut)
+{
+    static const struct { uint32_t bit; const char *name; } features[] = {
+        {FEATURE_COMPACT, "compact"}, {FEATURE_BATCH_FRAMES, "frames"}, {FEATURE_PROGRESS, "progress"},
+        {FEATURE_EXTENDED_RESULT, "extended"}, {FEATURE_TLV_COMMAND, "tlv"}, {FEATURE_CANCEL, "cancel"},
+        {FEATURE_PRIORITY, "priority"}, {FEATURE_SOAK, "soak"},
+    };
+    const tlv_caps_t *caps = &uut->caps;
+
+    fprintf(out, "%s:%u: ", inet_ntoa(uut->addr.sin_addr), ntohs(uut->addr.sin_port));
+    if (uut->state == CAPS_NO_REPLY) {
+        fprintf(out, "no capability reply\n");
+        return;
+    }
+    if (uut->state == CAPS_LEGACY) {
+        fprintf(out, "firmware without capability discovery\n");
+        return;
+    }
+
+    fprintf(out, "protocol %u, build \"%s\", peripherals", caps->version, caps->build_id);
+    for (int bit = 0; bit < PERIPHERAL_COUNT; bit++) {
+        if (caps->peripherals & (1 << bit)) fprintf(out, " %s", peripheral_name(1 << bit));
+    }
+    fprintf(out, ", patterns up to %u bytes, %u commands/%u results per frame, features",
+            caps->max_pattern, caps->max_batch, caps->result_batch);
+    for (size_t i = 0; i < sizeof(features) / sizeof(features[0]); i++) {
+        if (caps->features & features[i].bit) fprintf(out, " %s", features[i].name);
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,175 @@
+#include "cmd_pool.h"
+
+#include <string.h>
+#include "tlv.h"
+#include "FreeRTOS.h"
+#include "task.h"
+/*
+ * Fixed pool of command descriptors: one per test queue slot plus the running test and one
+ * preempting it.
+ * Taking and releasing a descriptor pops and pushes a free list - constant time, no heap,
+ * nothing to fragment however many commands arrive.
+ *
+ * Taken by the lwIP thread (udp_receive_callback) and released by the perform_tests task,
+ * so the free list is only touched inside short critical sections.
+ *
+ * A cancel (lwIP thread) marks the matching descriptors in the same critical sections: a
+ * queued one is answered by the caller and dropped by perform_tests() when it comes out of
+ * the test queue, the running one is stopped by its test between iterations (test_monitor_checkpoint).
+ */
+
+static cmd_desc_t pool[CMD_POOL_SIZE];
+static cmd_desc_t *free_list = NULL;
+static cmd_pool_stats_t stats;
+
+void cmd_pool_init(void){
+	taskENTER_CRITICAL();
+	free_list = NULL;
+	for(uint8_t i=0 ; i< CMD_POOL_SIZE ; i++){
+		pool[i].next = free_list;
+		free_list = &pool[i];
+	}
+	memset(&stats, 0, sizeof(stats));
+	taskEXIT_CRITICAL();
+}
+
+// Pops a descriptor off the free list, NULL when the pool is exhausted
+static cmd_desc_t* pool_pop(void){
+	taskENTER_CRITICAL();
+	cmd_desc_t *desc = free_list;
+	if (desc != NULL) {
+		free_list = desc->next;
+		desc->running = 0;
+		desc->cancelled = 0;
+		desc->priority = PRIORITY_DEFAULT;
+		desc->deadline = 0;
+		desc->soak_iterations = 0;
+		desc->soak_ms = 0;
+		stats.allocated++;
+		stats.in_use++;
+		if (stats.in_use > stats.high_water) stats.high_water = stats.in_use;
+	}
+	else {
+		stats.exhausted++;
+	}
+	taskEXIT_CRITICAL();
+	return desc;
+}
+
+/*
+ * @brief Takes a descriptor for a received command.
+ * The command stays in the pbuf when it is contiguous (the descriptor then holds its own
+ * reference, so one batch frame can back several descriptors), otherwise it is copied into
+ * the descriptor's block. Either way the caller still frees its reference to the pbuf.
+ * @param p: The received frame, already checked to hold a whole command at `offset`.
+ * @param offset: Where the command starts in the frame (0 for a single command).
+ * @retval The descriptor, NULL when the pool is exhausted.
+ */
+cmd_desc_t* cmd_pool_take(struct pbuf *p, u16_t offset){
+	cmd_desc_t *desc = pool_pop();
+	if (desc == NULL) return NULL;
+
+	if (p->len == p->tot_len) {
+		pbuf_ref(p);
+		desc->p = p;
+		desc->cmd = (test_command_t *)((uint8_t *)p->payload + offset);
+	}
+	else {
+		// A compact command leaves the rest of the block zeroed
+		u16_t cmd_len = p->tot_len - offset;
+		if (cmd_len > sizeof(test_command_t)) cmd_len = sizeof(test_command_t);
+		memset(&desc->copy, 0, sizeof(test_command_t));
+		pbuf_copy_partial(p, &desc->copy, cmd_len, offset);
+		desc->p = NULL;
+		desc->cmd = &desc->copy;
+		stats.copied++;
+	}
+	return desc;
+}
+
+/*
+ * @brief Takes a descriptor for a command that is not in a pbuf (decoded from a TLV frame),
+ * copying it into the descriptor's block.
+ * @retval The descriptor, NULL when the pool is exhausted.
+ */
+cmd_desc_t* cmd_pool_take_copy(const test_command_t *cmd){
+	cmd_desc_t *desc = pool_pop();
+	if (desc == NULL) return NULL;
+
+	desc->copy = *cmd;
+	desc->p = NULL;
+	desc->cmd = &desc->copy;
+	stats.copied++;
+	return desc;
+}
+
+/*
+ * @brief Returns a descriptor to the pool, dropping its reference to the pbuf.
+ */
+void cmd_pool_release(cmd_desc_t *desc){
+	if (desc == NULL) return;
+	struct pbuf *p = desc->p;
+	desc->cmd = NULL;		// cmd_pool_cancel() no longer looks at the command
+	desc->p = NULL;
+	if (p != NULL) pbuf_free(p);
+
+	taskENTER_CRITICAL();
+	desc->next = free_list;
+	free_list = desc;
+	stats.in_use--;
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * @brief Called by perform_tests() with a descriptor it took out of the test queue.
+ * @retval 1 - run the command, 0 - it was cancelled (and answered) while queued: release it.
+ */
+uint8_t cmd_pool_start(cmd_desc_t *desc){
+	taskENTER_CRITICAL();
+	uint8_t run = !desc->cancelled;
+	desc->running = run;
+	taskEXIT_CRITICAL();
+	return run;
+}
+
+/*
+ * @brief Cancels the queued and running commands with a test ID sent by one controller.
+ *        Controllers number their tests independently, so commands of other senders are kept.
+ * @param test_id: The test to cancel, 0 - every queued and running command of the controller.
+ * @param addr, port: The controller the commands came from, port 0 - any port of its address.
+ * @param queued: Filled with the queued commands that were dropped (CMD_POOL_SIZE entries),
+ *                the caller sends their results. The running one ends with its own result.
+ * @param queued_count: Number of entries filled in.
+ * @retval Commands cancelled, the running one included.
+ */
+uint8_t cmd_pool_cancel(uint32_t test_id, const ip_addr_t *addr, u16_t port, cmd_cancelled_t *queued, uint8_t *queued_count){
+	uint8_t count = 0;
+
+	*queued_count = 0;
+	taskENTER_CRITICAL();
+	for(uint8_t i=0 ; i< CMD_POOL_SIZE ; i++){
+		cmd_desc_t *desc = &pool[i];
+		if (desc->cmd == NULL || desc->cancelled) continue;		// Free, or cancelled before
+		if (test_id != 0 && desc->cmd->test_id != test_id) continue;
+		if (!ip_addr_cmp(&desc->reply_addr, addr) || (port != 0 && desc->reply_port != port)) continue;
+
+		desc->cancelled = 1;
+		count++;
+		if (desc->running) continue;
+
+		cmd_cancelled_t *entry = &queued[(*queued_count)++];
+		entry->test_id = desc->cmd->test_id;
+		ip_addr_copy(entry->reply_addr, desc->reply_addr);
+		entry->reply_port = desc->reply_port;
+		entry->extended = (desc->cmd->peripheral & EXTENDED_RESULT) != 0;
+	}
+	stats.cancelled += count;
+	taskEXIT_CRITICAL();
+	return count;
+}
+
+void cmd_pool_get_stats(cmd_pool_stats_t *out){
+	taskENTER_CRITICAL();
+	*out = stats;
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,347 @@
+/**
+  * @brief Fleet mode: drives many UUTs concurrently from one epoll loop
+  *
+  * Every UUT gets its own socket and pipeline (window and timeouts are per UUT). The UUTs
+  * are split between network threads (one per core by default), each servicing its share
+  * from one epoll loop - or one io_uring. A UUT that stops answering only stalls its own
+  * pipeline. Results are logged on a separate thread (see outcome_queue.h).
+  */
+#define _GNU_SOURCE             // pthread_setaffinity_np()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "fleet.h"
+#include "outcome_queue.h"
+
+#define FLEET_EVENTS    64
+
+/*
+ * @brief Reads the UUT list: one "ip[:port]" per line, '#' starts a comment.
+ * @retval 0 on success, -1 on a missing file, bad line or empty list.
+ */
+int fleet_load(fleet_t *fleet, const char *path)
+{
+    char line[128];
+    int line_num = 0;
+
+    memset(fleet, 0, sizeof(*fleet));
+
+    FILE *file_ptr = fopen(path, "r");
+    if (file_ptr == NULL) {
+        perror("Error: Could not open the UUT list");
+        return -1;
+    }
+
+    fleet->uuts = calloc(FLEET_MAX_UUTS, sizeof(fleet_uut_t));
+    if (fleet->uuts == NULL) {
+        perror("Error: Could not allocate the fleet");
+        fclose(file_ptr);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file_ptr) != NULL) {
+        line_num++;
+
+        // Strip comments and surrounding white space
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char *text = line;
+        while (isspace((unsigned char)*text)) text++;
+        char *end = text + strlen(text);
+        while (end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*text == '\0') continue;
+
+        if (fleet->count == FLEET_MAX_UUTS) {
+            printf("Too many UUTs in %s (max %d)\n", path, FLEET_MAX_UUTS);
+            fclose(file_ptr);
+            return -1;
+        }
+        if (parse_address(text, &fleet->uuts[fleet->count].addr) < 0) {
+            printf("%s:%d: invalid UUT address '%s'\n", path, line_num, text);
+            fclose(file_ptr);
+            return -1;
+        }
+        fleet->uuts[fleet->count].sockfd = -1;
+        fleet->count++;
+    }
+    fclose(file_ptr);
+
+    if (fleet->count == 0) {
+        printf("No UUTs listed in %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int fleet_next_timeout(const fleet_t *fleet, size_t first, size_t end, double now)
+{
+    int nearest = -1;
+
+    for (size_t i = first; i < end; i++) {
+        int wait = pipeline_next_timeout(&fleet->uuts[i].pipeline, now);
+        if (wait >= 0 && (nearest < 0 || wait < nearest)) nearest = wait;
+    }
+    return nearest;
+}
+
+static int fleet_open_socket(void)
+{
+    struct sockaddr_in local_addr;
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Any free port: the UUT answers to whichever port the command came from
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port = 0;
+    if (bind(sockfd, (const struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        perror("Bind failed");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Runs the pipelines of UUTs [first, end) on the calling thread
+static int fleet_worker_run(fleet_worker_t *worker)
+{
+    fleet_t *fleet = worker->fleet;
+    struct epoll_event events[FLEET_EVENTS];
+    size_t running = worker->end - worker->first;
+    pipeline_config_t uut_cfg = *worker->cfg;
+
+    // One ring per worker rather than one per UUT
+    uut_cfg.io_uring = 0;
+    if (worker->cfg->io_uring && !worker->cfg->kernel_timestamps) worker->ring = uring_create(URING_ENTRIES);
+
+    if (worker->ring == NULL) {
+        worker->epfd = epoll_create1(0);
+        if (worker->epfd < 0) {
+            perror("epoll_create1 failed");
+            return -1;
+        }
+    }
+
+    for (size_t i = worker->first; i < worker->end; i++) {
+        fleet_uut_t *uut = &fleet->uuts[i];
+
+        uut->sockfd = fleet_open_socket();
+        if (uut->sockfd < 0) return -1;
+        if (pipeline_init(&uut->pipeline, uut->sockfd, &uut->addr, worker->commands + i * worker->per_uut,
+                          worker->per_uut, &uut_cfg, outcome_ring_push, worker->results) < 0) {
+            return -1;
+        }
+        if (worker->deadlines_ms != NULL) {
+            pipeline_set_deadlines(&uut->pipeline, worker->deadlines_ms + i * worker->per_uut);
+        }
+
+        if (worker->ring != NULL) {
+            if (pipeline_use_ring(&uut->pipeline, worker->ring) < 0) return -1;
+        }
+        else {
+            struct epoll_event ev = {.events = EPOLLIN, .data.ptr = uut};
+            if (epoll_ctl(worker->epfd, EPOLL_CTL_ADD, uut->sockfd, &ev) < 0) {
+                perror("epoll_ctl failed");
+                return -1;
+            }
+        }
+        if (pipeline_fill(&uut->pipeline) < 0) return -1;
+    }
+
+    while (running > 0) {
+        int timeout = fleet_next_timeout(fleet, worker->first, worker->end, time_now());
+
+        if (worker->ring != NULL) {
+            // Submits the queued sends and waits in one call
+            if (uring_wait(worker->ring, timeout) < 0 && errno != EINTR && errno != ETIME) {
+                perror("io_uring_enter failed");
+                return -1;
+            }
+            if (pipeline_reap(worker->ring) < 0) return -1;
+        }
+        else {
+            int ready = epoll_wait(worker->epfd, events, FLEET_EVENTS, timeout);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait failed");
+                return -1;
+            }
+
+            for (int k = 0; k < ready; k++) {
+                fleet_uut_t *uut = events[k].data.ptr;
+                if (pipeline_drain(&uut->pipeline) < 0) return -1;
+            }
+        }
+
+        double now = time_now();
+        for (size_t i = worker->first; i < worker->end; i++) {
+            fleet_uut_t *uut = &fleet->uuts[i];
+            if (uut->finished > 0) continue;
+
+            pipeline_expire(&uut->pipeline, now);
+            if (pipeline_fill(&uut->pipeline) < 0) return -1;
+
+            if (pipeline_done(&uut->pipeline)) {
+                uut->finished = now;
+                if (worker->epfd >= 0) epoll_ctl(worker->epfd, EPOLL_CTL_DEL, uut->sockfd, NULL);
+                running--;
+            }
+        }
+    }
+    return 0;
+}
+
+static void *fleet_worker_main(void *arg)
+{
+    fleet_worker_t *worker = arg;
+
+    worker->status = fleet_worker_run(worker);
+    outcome_ring_close(worker->results);
+    return NULL;
+}
+
+// Keeps a worker on the n-th core the process may run on, so its sockets' cache lines stay
+// there (best effort)
+static void fleet_pin(pthread_t thread, const cpu_set_t *allowed, unsigned n)
+{
+    cpu_set_t cpus;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, allowed) || n-- > 0) continue;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+        return;
+    }
+}
+
+/*
+ * @brief Runs `per_uut` commands on every UUT of the fleet at once.
+ * The UUTs are split between fleet->threads network threads (0 - one per core), each with its
+ * own epoll set or ring. Outcomes reach on_outcome through a logging thread, so on_outcome is
+ * never called concurrently and never on a network thread.
+ * @param commands: fleet->count * per_uut commands, UUT i runs commands[i * per_uut ...].
+ * @param deadlines_ms: Per command deadlines laid out like the commands, may be NULL.
+ * @retval 0 on success, -1 on a socket or thread error.
+ */
+int fleet_run(fleet_t *fleet, const test_command_t *commands, const unsigned *deadlines_ms, size_t per_uut,
+              const pipeline_config_t *cfg, outcome_cb on_outcome, void *ctx)
+{
+    cpu_set_t allowed;
+    // The cores of a restricted cpuset (taskset, containers), not every core online
+    long cores = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT(&allowed) : -1;
+    size_t threads = fleet->threads ? fleet->threads : (cores > 0 ? (size_t)cores : 1);
+    outcome_queue_t queue;
+    int status = 0;
+
+    if (threads > fleet->count) threads = fleet->count;
+    fleet->workers = calloc(threads, sizeof(fleet_worker_t));
+    if (fleet->workers == NULL) {
+        perror("Error: Could not allocate the fleet workers");
+        return -1;
+    }
+    fleet->worker_count = threads;
+    for (size_t w = 0; w < threads; w++) fleet->workers[w].epfd = -1;
+    if (outcome_queue_start(&queue, threads, on_outcome, ctx) < 0) return -1;
+
+    fleet->started = time_now();
+    for (size_t w = 0; w < threads; w++) {
+        fleet_worker_t *worker = &fleet->workers[w];
+
+        // Contiguous, evenly sized shares of the UUT list
+        worker->fleet = fleet;
+        worker->first = fleet->count * w / threads;
+        worker->end = fleet->count * (w + 1) / threads;
+        worker->commands = commands;
+        worker->deadlines_ms = deadlines_ms;
+        worker->per_uut = per_uut;
+        worker->cfg = cfg;
+        worker->results = outcome_queue_ring(&queue, w);
+
+        if (threads == 1) break;        // Runs on this thread
+        int err = pthread_create(&worker->thread, NULL, fleet_worker_main, worker);
+        if (err != 0) {
+            printf("Error: Could not start a fleet worker: %s\n", strerror(err));
+            worker->status = -1;
+            outcome_ring_close(worker->results);
+            continue;
+        }
+        worker->started = 1;
+        if (cores > 0 && threads <= (size_t)cores) fleet_pin(worker->thread, &allowed, (unsigned)w);
+    }
+
+    if (threads == 1) fleet_worker_main(&fleet->workers[0]);
+    for (size_t w = 0; w < threads; w++) {
+        if (fleet->workers[w].started) pthread_join(fleet->workers[w].thread, NULL);
+        if (fleet->workers[w].status < 0) status = -1;
+    }
+    if (outcome_queue_stop(&queue) < 0) status = -1;
+    if (queue.full_waits > 0) {
+        printf("Warning: Logging fell behind, network threads waited for it %zu times\n", queue.full_waits);
+    }
+    return status;
+}
+
+/*
+ * @brief Prints per UUT results and the aggregate throughput of the fleet.
+ */
+void fleet_report(const fleet_t *fleet, double elapsed)
+{
+    size_t completed = 0, passed = 0, failed = 0, errors = 0, timeouts = 0, retransmits = 0;
+
+    printf("%-21s %8s %8s %8s %8s %8s %8s %10s\n", "UUT", "Tests", "Passed", "Failed", "Errors", "Timeouts", "Resent",
+           "Tests/sec");
+    for (size_t i = 0; i < fleet->count; i++) {
+        const fleet_uut_t *uut = &fleet->uuts[i];
+        const pipeline_t *pl = &uut->pipeline;
+        char name[32];
+        double took = uut->finished - fleet->started;
+
+        snprintf(name, sizeof(name), "%s:%u", inet_ntoa(uut->addr.sin_addr), ntohs(uut->addr.sin_port));
+        printf("%-21s %8zu %8zu %8zu %8zu %8zu %8zu %10.1f\n", name, pl->completed, pl->passed, pl->failed,
+               pl->errors, pl->timeouts, pl->retransmits, took > 0 ? pl->completed / took : 0.0);
+
+        completed += pl->completed;
+        passed += pl->passed;
+        failed += pl->failed;
+        errors += pl->errors;
+        timeouts += pl->timeouts;
+        retransmits += pl->retransmits;
+    }
+    printf("%zu UUTs, %zu tests in %.3f s (%.1f tests/sec): %zu passed, %zu failed, %zu errors, %zu timed out, %zu resent\n",
+           fleet->count, completed, elapsed, elapsed > 0 ? completed / elapsed : 0.0,
+           passed, failed, errors, timeouts, retransmits);
+}
+
+void fleet_free(fleet_t *fleet)
+{
+    // Closing the rings first cancels the receives still pointing at the pipelines
+    for (size_t w = 0; w < fleet->worker_count; w++) {
+        uring_free(fleet->workers[w].ring);
+        if (fleet->workers[w].epfd >= 0) close(fleet->workers[w].epfd);
+    }
+    free(fleet->workers);
+    fleet->workers = NULL;
+    fleet->worker_count = 0;
+    for (size_t i = 0; i < fleet->count; i++) {
+        pipeline_free(&fleet->uuts[i].pipeline);
+        if (fleet->uuts[i].sockfd >= 0) close(fleet->uuts[i].sockfd);
+    }
+    free(fleet->uuts);
+    fleet->uuts = NULL;
+    fleet->count = 0;
+}
@@ -32,8 +32,10 @@ Result i2c_testing(test_command_t* command){
     memcpy(tx_buffer, command->bit_pattern, command->bit_pattern_length);
 
 	for(uint8_t i=0 ; i< command->iterations ; i++){
+	    if (test_monitor_checkpoint()) return TEST_ERR;
 //	    printf("I2C_TEST: Iteration %u/%u -\n\r", i + 1, command->iterations); // Debug printf
 	    memset(rx_buffer, 0, command->bit_pattern_length);
+	    test_monitor_iteration_start();
 
 	    // --- 1. START RECEIVE DMA FIRST (SLAVE) ---
 	    status = HAL_I2C_Slave_Receive_DMA(I2C_RECEIVER, echo_buffer, command->bit_pattern_length);
@@ -54,6 +56,7 @@ Result i2c_testing(test_command_t* command){
 	    // --- 3. WAIT FOR BOTH TX DMA COMPLETION ---
 	    if (xSemaphoreTake(I2cTxHandle, TIMEOUT) != pdPASS) {
 	         printf("Master TX timeout\n\r"); // Debug printf
+	         test_monitor_timeout();
 	         i2c_reset(I2C_SENDER); // Reset the Master on timeout
 	         i2c_reset(I2C_RECEIVER); // Reset the Slave as a precaution
 	         return TEST_FAIL;
@@ -80,6 +83,7 @@ Result i2c_testing(test_command_t* command){
 	    //  WAIT FOR BOTH RX DMA COMPLETION
 	    if (xSemaphoreTake(I2cRxHandle, TIMEOUT) != pdPASS) {
 	         printf("Slave RX timeout\n\r"); // Debug printf
+			 test_monitor_timeout();
 			 i2c_reset(I2C_SENDER); // Reset the Master on timeout
 	         i2c_reset(I2C_RECEIVER); // Reset the Slave as a precaution
 	         return TEST_FAIL;
@@ -90,19 +94,22 @@ Result i2c_testing(test_command_t* command){
 	        uint32_t sent_crc = calculate_crc(tx_buffer, command->bit_pattern_length);
 	        uint32_t received_crc = calculate_crc(rx_buffer, command->bit_pattern_length);
 	        if (sent_crc != received_crc) {
+	            test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 //	            printf("I2C_TEST: CRC mismatch on iteration %u.\n\r", i + 1); // Debug printf
 	            return TEST_FAIL;
 	        }
 	    } else {
 	        int comp = memcmp(tx_buffer, rx_buffer, command->bit_pattern_length);
 	        if (comp != 0) {
+	            test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 	            printf("Data mismatch on iteration %u.\n\r", i + 1); // Debug printf
 	            return TEST_FAIL;
 	        }
 	    }
 //	    printf("Data Match on iteration %u.\n\r", i + 1); // Debug printf
+        test_monitor_iteration(i);
 
-        osDelay(10);
+        test_monitor_pace();
 	}
     return TEST_PASS;
 }
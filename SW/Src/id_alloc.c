@@ -0,0 +1,114 @@
+/**
+  * @brief Test ID allocation shared by every client process on the machine
+  *
+  * The last issued ID lives in a small memory-mapped file. Allocating is a single atomic
+  * fetch-add on the shared mapping - no file rewrite, no lock - so parallel clients never
+  * hand out the same ID. The page belongs to the kernel's page cache, so a crashed client
+  * cannot leave it half written. The file lock is only taken once, to create the file.
+  */
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "project_header.h"
+#include "id_alloc.h"
+
+static id_counter_t *counter = NULL;
+
+// Last ID written by the text counter of older clients, 0 if there is none
+static uint64_t read_legacy_count(const char *legacy_path)
+{
+    unsigned long long last = 0;
+
+    if (legacy_path == NULL) return 0;
+    FILE *file_ptr = fopen(legacy_path, "r");
+    if (file_ptr == NULL) return 0;
+    if (fscanf(file_ptr, "%llu", &last) != 1) last = 0;
+    fclose(file_ptr);
+    return last;
+}
+
+/*
+ * @brief Maps the counter file, creating (and seeding it from legacy_path) on first use.
+ * @param path: Counter file.
+ * @param legacy_path: Text counter file to continue from, may be NULL.
+ * @retval 0 on success, -1 on failure.
+ */
+int id_alloc_open(const char *path, const char *legacy_path)
+{
+    struct stat st;
+
+    if (counter != NULL) return 0;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Error: Could not open the ID counter file");
+        return -1;
+    }
+
+    // Serializes creation only: a second client waits here until the file is initialized
+    if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0) {
+        perror("Error: Could not lock the ID counter file");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(id_counter_t) && ftruncate(fd, sizeof(id_counter_t)) < 0) {
+        perror("Error: Could not size the ID counter file");
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, sizeof(id_counter_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Error: Could not map the ID counter file");
+        close(fd);
+        return -1;
+    }
+    counter = map;
+
+    if (__atomic_load_n(&counter->magic, __ATOMIC_ACQUIRE) != ID_MAGIC) {
+        counter->version = ID_VERSION;
+        __atomic_store_n(&counter->last_id, read_legacy_count(legacy_path), __ATOMIC_RELAXED);
+        __atomic_store_n(&counter->magic, ID_MAGIC, __ATOMIC_RELEASE);
+        msync(map, sizeof(id_counter_t), MS_SYNC);
+    }
+
+    // The mapping stays valid after the descriptor (and with it the lock) is gone
+    close(fd);
+    return 0;
+}
+
+/*
+ * @brief Reserves `count` consecutive test IDs.
+ * @retval The first reserved ID, 0 if the allocator is not open.
+ */
+uint32_t id_alloc_reserve(uint32_t count)
+{
+    if (counter == NULL || count == 0) return 0;
+
+    uint64_t last = __atomic_fetch_add(&counter->last_id, count, __ATOMIC_RELAXED);
+    uint32_t first = (uint32_t)(last + 1);
+
+    // ID 0 is never valid on the UUT side and IDs from BATCH_TAG_FIRST up tag batch frames:
+    // skip them if the 32-bit range wrapped
+    if (first == 0 || (uint32_t)(first + count - 1) < first || (uint32_t)(first + count - 1) >= BATCH_TAG_FIRST) {
+        return id_alloc_reserve(count);
+    }
+    return first;
+}
+
+uint32_t id_alloc_next(void)
+{
+    return id_alloc_reserve(1);
+}
+
+void id_alloc_close(void)
+{
+    if (counter == NULL) return;
+    munmap(counter, sizeof(id_counter_t));
+    counter = NULL;
+}
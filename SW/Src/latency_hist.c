@@ -0,0 +1,106 @@
+/**
+  * @brief Latency histograms with bounded relative error and constant-time recording
+  */
+#include <string.h>
+
+#include "latency_hist.h"
+
+static unsigned hist_index(uint64_t value)
+{
+    if (value < (1u << HIST_SUB_BITS)) return (unsigned)value;
+
+    if (value >> HIST_MAX_BITS) value = (1ull << HIST_MAX_BITS) - 1;
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - HIST_SUB_BITS + 1;
+    // value >> shift is in [HIST_HALF, 2 * HIST_HALF)
+    return shift * HIST_HALF + (unsigned)(value >> shift);
+}
+
+// Highest value that falls into the bucket
+static uint64_t hist_bucket_value(unsigned index)
+{
+    if (index < (1u << HIST_SUB_BITS)) return index;
+
+    unsigned shift = index / HIST_HALF - 1;
+    uint64_t mantissa = index - shift * HIST_HALF;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void hist_init(latency_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void hist_record(latency_hist_t *hist, uint64_t value_ns)
+{
+    hist->counts[hist_index(value_ns)]++;
+    hist->total++;
+    hist->sum += value_ns;
+    if (value_ns < hist->min) hist->min = value_ns;
+    if (value_ns > hist->max) hist->max = value_ns;
+}
+
+void hist_merge(latency_hist_t *into, const latency_hist_t *from)
+{
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+    into->total += from->total;
+    into->sum += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+/*
+ * @brief Value below or at which `percentile` percent of the recorded values fall.
+ * @param percentile: 0..100
+ * @retval Nanoseconds, 0 for an empty histogram.
+ */
+uint64_t hist_percentile(const latency_hist_t *hist, double percentile)
+{
+    if (hist->total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->total) rank = hist->total;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = hist_bucket_value(i);
+            return value > hist->max ? hist->max : value;
+        }
+    }
+    return hist->max;
+}
+
+void hist_print_header(FILE *out)
+{
+    fprintf(out, "%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+            "Periph", "Count", "p50 (ms)", "p90 (ms)", "p99 (ms)", "p99.9 (ms)", "Max (ms)", "Mean (ms)");
+}
+
+void hist_print(FILE *out, const char *name, const latency_hist_t *hist)
+{
+    if (hist->total == 0) return;
+    fprintf(out, "%-8s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+            (unsigned long long)hist->total,
+            hist_percentile(hist, 50) / 1e6, hist_percentile(hist, 90) / 1e6,
+            hist_percentile(hist, 99) / 1e6, hist_percentile(hist, 99.9) / 1e6,
+            hist->max / 1e6, hist->sum / hist->total / 1e6);
+}
+
+void hist_export_header(FILE *out)
+{
+    fprintf(out, "peripheral,count,min_us,p50_us,p90_us,p99_us,p999_us,max_us,mean_us\n");
+}
+
+void hist_export(FILE *out, const char *name, const latency_hist_t *hist)
+{
+    if (hist->total == 0) return;
+    fprintf(out, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", name,
+            (unsigned long long)hist->total, hist->min / 1e3,
+            hist_percentile(hist, 50) / 1e3, hist_percentile(hist, 90) / 1e3,
+            hist_percentile(hist, 99) / 1e3, hist_percentile(hist, 99.9) / 1e3,
+            hist->max / 1e3, hist->sum / hist->total / 1e3);
+}
@@ -0,0 +1,292 @@
+/**
+  * @brief On-disk index over a binary result log
+  *
+  * Two files next to the log, both memory mapped:
+  *   <log>.idx - open addressing table test_id -> record number
+  *   <log>.tdx - per LOG_INDEX_BUCKET_SEC of send time, the first and last record sent in it
+  * The index remembers how many records it covers, so an update only reads the records
+  * appended since. A lookup touches a few slots, a time range query a few buckets and then
+  * only the records between them - both independent of the log's size.
+  */
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log_index.h"
+
+static log_index_slot_t *index_slots(const log_index_t *idx)
+{
+    return (log_index_slot_t *)(idx->ids + 1);
+}
+
+static log_time_bucket_t *index_buckets(const log_index_t *idx)
+{
+    return (log_time_bucket_t *)(idx->times + 1);
+}
+
+static size_t index_home(uint32_t test_id, uint64_t slot_count)
+{
+    return (test_id * 2654435761u) & (slot_count - 1);
+}
+
+static int64_t time_bucket(int64_t sent_us)
+{
+    int64_t width = (int64_t)LOG_INDEX_BUCKET_SEC * 1000000;
+    return sent_us >= 0 ? sent_us / width : (sent_us - width + 1) / width;
+}
+
+// Resizes a mapped file, the old mapping is replaced
+static void *remap_file(int fd, void *map, size_t old_length, size_t length)
+{
+    if (map != NULL) munmap(map, old_length);
+    if (ftruncate(fd, length) < 0) {
+        perror("Error: Could not size the log index");
+        return NULL;
+    }
+    map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Error: Could not map the log index");
+        return NULL;
+    }
+    return map;
+}
+
+// Empties the ID table at the given size. The magic is written last: a crash midway leaves a file that is rebuilt
+static int reset_ids(log_index_t *idx, uint64_t slot_count)
+{
+    size_t length = sizeof(log_index_header_t) + slot_count * sizeof(log_index_slot_t);
+
+    idx->ids = remap_file(idx->id_fd, idx->ids, idx->ids_length, length);
+    if (idx->ids == NULL) return -1;
+    idx->ids_length = length;
+
+    idx->ids->magic = 0;
+    idx->ids->version = LOG_INDEX_VERSION;
+    idx->ids->indexed = 0;
+    idx->ids->slot_count = slot_count;
+    idx->ids->used = 0;
+    memset(index_slots(idx), 0xFF, slot_count * sizeof(log_index_slot_t));
+    idx->ids->magic = LOG_INDEX_MAGIC;
+    return 0;
+}
+
+static int reset_times(log_index_t *idx)
+{
+    idx->times = remap_file(idx->time_fd, idx->times, idx->times_length, sizeof(log_time_header_t));
+    if (idx->times == NULL) return -1;
+    idx->times_length = sizeof(log_time_header_t);
+
+    memset(idx->times, 0, sizeof(log_time_header_t));
+    idx->times->version = LOG_INDEX_VERSION;
+    idx->times->magic = LOG_TIME_INDEX_MAGIC;
+    return 0;
+}
+
+static int map_existing(int fd, void **map, size_t *length, size_t header_size)
+{
+    struct stat st;
+
+    *map = NULL;
+    *length = 0;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < header_size) return 0;
+
+    *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return -1;
+    }
+    *length = st.st_size;
+    return 0;
+}
+
+/*
+ * @brief Opens (or creates) the index files of a log and locks them for this process.
+ * @retval 0 on success, -1 on failure.
+ */
+int log_index_open(log_index_t *idx, const char *log_path)
+{
+    memset(idx, 0, sizeof(*idx));
+    idx->id_fd = idx->time_fd = -1;
+    snprintf(idx->id_path, sizeof(idx->id_path), "%s%s", log_path, LOG_INDEX_SUFFIX);
+    snprintf(idx->time_path, sizeof(idx->time_path), "%s%s", log_path, LOG_TIME_INDEX_SUFFIX);
+
+    idx->id_fd = open(idx->id_path, O_RDWR | O_CREAT, 0644);
+    idx->time_fd = open(idx->time_path, O_RDWR | O_CREAT, 0644);
+    if (idx->id_fd < 0 || idx->time_fd < 0) {
+        perror("Error: Could not open the log index");
+        log_index_close(idx);
+        return -1;
+    }
+
+    // One updater at a time; held until log_index_close()
+    if (flock(idx->id_fd, LOCK_EX) < 0) {
+        perror("Error: Could not lock the log index");
+        log_index_close(idx);
+        return -1;
+    }
+
+    if (map_existing(idx->id_fd, (void **)&idx->ids, &idx->ids_length, sizeof(log_index_header_t)) < 0 ||
+        map_existing(idx->time_fd, (void **)&idx->times, &idx->times_length, sizeof(log_time_header_t)) < 0) {
+        perror("Error: Could not map the log index");
+        log_index_close(idx);
+        return -1;
+    }
+
+    // Missing, foreign or half built files start over, together
+    int ids_valid = idx->ids != NULL && idx->ids->magic == LOG_INDEX_MAGIC && idx->ids->version == LOG_INDEX_VERSION &&
+                    idx->ids_length >= sizeof(log_index_header_t) + idx->ids->slot_count * sizeof(log_index_slot_t);
+    int times_valid = idx->times != NULL && idx->times->magic == LOG_TIME_INDEX_MAGIC &&
+                      idx->times_length >= sizeof(log_time_header_t) + idx->times->bucket_count * sizeof(log_time_bucket_t);
+    if (!ids_valid || !times_valid) {
+        if (reset_ids(idx, LOG_INDEX_MIN_SLOTS) < 0 || reset_times(idx) < 0) {
+            log_index_close(idx);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void insert_id(log_index_t *idx, uint32_t test_id, uint32_t record)
+{
+    log_index_slot_t *slots = index_slots(idx);
+    uint64_t mask = idx->ids->slot_count - 1;
+    size_t i = index_home(test_id, idx->ids->slot_count);
+
+    while (slots[i].record != LOG_INDEX_NO_RECORD) i = (i + 1) & mask;
+    slots[i].test_id = test_id;
+    slots[i].record = record;
+    idx->ids->used++;
+}
+
+// Makes room for the buckets up to `bucket` (relative to base_bucket)
+static int grow_times(log_index_t *idx, uint64_t bucket)
+{
+    uint64_t old_count = idx->times->bucket_count;
+    uint64_t count = (bucket + 1024) & ~(uint64_t)1023;
+    size_t length = sizeof(log_time_header_t) + count * sizeof(log_time_bucket_t);
+
+    idx->times = remap_file(idx->time_fd, idx->times, idx->times_length, length);
+    if (idx->times == NULL) return -1;
+    idx->times_length = length;
+
+    log_time_bucket_t *buckets = index_buckets(idx);
+    for (uint64_t b = old_count; b < count; b++) {
+        buckets[b].first = LOG_INDEX_NO_RECORD;
+        buckets[b].last = 0;
+    }
+    idx->times->bucket_count = count;
+    return 0;
+}
+
+/*
+ * @brief Indexes the records appended to the log since the last update.
+ * Grows (and rebuilds) the ID table when it gets too full; starts over if the log shrank.
+ * @retval Number of records added to the index, -1 on failure.
+ */
+int log_index_update(log_index_t *idx, const result_log_map_t *view)
+{
+    uint64_t from = idx->ids->indexed;
+
+    if (view->count > LOG_INDEX_NO_RECORD) {
+        printf("Error: The log is too large to index\n");
+        return -1;
+    }
+    if (view->count < from) {
+        // Replaced or truncated log
+        if (reset_ids(idx, LOG_INDEX_MIN_SLOTS) < 0 || reset_times(idx) < 0) return -1;
+        from = 0;
+    }
+    if (view->count == from) return 0;
+
+    // Grow by doubling and re-insert everything: amortized O(1) per record
+    uint64_t slot_count = idx->ids->slot_count;
+    while ((double)view->count > slot_count * LOG_INDEX_MAX_LOAD) slot_count *= 2;
+    if (slot_count != idx->ids->slot_count) {
+        if (reset_ids(idx, slot_count) < 0) return -1;
+        for (uint64_t r = 0; r < from; r++) insert_id(idx, view->records[r].test_id, (uint32_t)r);
+    }
+
+    if (idx->times->bucket_count == 0) idx->times->base_bucket = time_bucket(view->records[from].sent_us);
+    int64_t base = idx->times->base_bucket;
+    int64_t newest = 0;
+    for (uint64_t r = from; r < view->count; r++) {
+        int64_t b = time_bucket(view->records[r].sent_us) - base;
+        if (b > newest) newest = b;
+    }
+    if ((uint64_t)newest >= idx->times->bucket_count && grow_times(idx, newest) < 0) return -1;
+
+    log_time_bucket_t *buckets = index_buckets(idx);
+    for (uint64_t r = from; r < view->count; r++) {
+        const result_record_t *record = &view->records[r];
+        int64_t b = time_bucket(record->sent_us) - base;
+        if (b < 0) b = 0;
+
+        insert_id(idx, record->test_id, (uint32_t)r);
+        if (buckets[b].first == LOG_INDEX_NO_RECORD || r < buckets[b].first) buckets[b].first = (uint32_t)r;
+        if (r > buckets[b].last) buckets[b].last = (uint32_t)r;
+    }
+    idx->ids->indexed = view->count;
+    return (int)(view->count - from);
+}
+
+/*
+ * @brief Record numbers of a test ID (more than one if the ID was logged again).
+ * @retval How many records were found, at most max_records of them are stored.
+ */
+size_t log_index_find(const log_index_t *idx, uint32_t test_id, size_t *records, size_t max_records)
+{
+    const log_index_slot_t *slots = index_slots(idx);
+    uint64_t mask = idx->ids->slot_count - 1;
+    size_t i = index_home(test_id, idx->ids->slot_count);
+    size_t found = 0;
+
+    while (slots[i].record != LOG_INDEX_NO_RECORD) {
+        if (slots[i].test_id == test_id) {
+            if (found < max_records) records[found] = slots[i].record;
+            found++;
+        }
+        i = (i + 1) & mask;
+    }
+    return found;
+}
+
+/*
+ * @brief The records to scan for tests sent between from_us and to_us (micros since the epoch).
+ * The range may contain records outside the times, the caller filters them.
+ * @retval 0 with [*first, *last] set, -1 if no record was sent in that time.
+ */
+int log_index_range(const log_index_t *idx, int64_t from_us, int64_t to_us, size_t *first, size_t *last)
+{
+    const log_time_bucket_t *buckets = index_buckets(idx);
+    int64_t count = (int64_t)idx->times->bucket_count;
+    int64_t from_b = time_bucket(from_us) - idx->times->base_bucket;
+    int64_t to_b = time_bucket(to_us) - idx->times->base_bucket;
+    int found = 0;
+
+    if (count == 0 || to_b < 0 || from_b >= count || from_us > to_us) return -1;
+    if (from_b < 0) from_b = 0;
+    if (to_b >= count) to_b = count - 1;
+
+    for (int64_t b = from_b; b <= to_b; b++) {
+        if (buckets[b].first == LOG_INDEX_NO_RECORD) continue;
+        if (!found || buckets[b].first < *first) *first = buckets[b].first;
+        if (!found || buckets[b].last > *last) *last = buckets[b].last;
+        found = 1;
+    }
+    return found ? 0 : -1;
+}
+
+void log_index_close(log_index_t *idx)
+{
+    if (idx->ids != NULL) munmap(idx->ids, idx->ids_length);
+    if (idx->times != NULL) munmap(idx->times, idx->times_length);
+    if (idx->id_fd >= 0) close(idx->id_fd);         // Releases the lock
+    if (idx->time_fd >= 0) close(idx->time_fd);
+    idx->ids = NULL;
+    idx->times = NULL;
+    idx->id_fd = idx->time_fd = -1;
+}
@@ -0,0 +1,227 @@
+/**
+  * @brief Reader for the binary result log written by udp_server -B
+  *
+  * export         : prints the log as the testing_log.txt table
+  * stats          : counts records per result and peripheral
+  * index          : builds the index files next to the log, or adds the records appended since
+  * find ID...     : prints the records of the given test IDs
+  * range FROM TO  : prints the records sent between two times ("dd-mm-YYYY HH:MM:SS" or @epoch seconds)
+  * find and range bring the index up to date first.
+  *
+  * @param -f file: Binary log (default RESULT_LOG_FILE)
+  * @param 1: Command (export/stats/index/find/range) and its arguments
+  * @retval None
+  */
+#define _GNU_SOURCE             // strptime()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "result_log.h"
+#include "log_index.h"
+
+#define FIND_MAX_RECORDS    64      // records printed per test ID
+
+static double elapsed_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int export_log(const result_log_map_t *view)
+{
+    static char out_buffer[1 << 16];
+
+    setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+    result_log_print_header(stdout);
+    for (size_t i = 0; i < view->count; i++) {
+        result_log_print_record(stdout, &view->records[i]);
+    }
+    return 0;
+}
+
+static int print_stats(const result_log_map_t *view)
+{
+    // The last slot collects records of unknown peripherals
+    size_t passed[PERIPHERAL_COUNT + 1] = {0}, failed[PERIPHERAL_COUNT + 1] = {0};
+    size_t errors[PERIPHERAL_COUNT + 1] = {0}, timeouts = 0;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < view->count; i++) {
+        const result_record_t *record = &view->records[i];
+        int slot = peripheral_slot(record->peripheral);
+        if (slot < 0) slot = PERIPHERAL_COUNT;
+
+        if (record->flags & RECORD_TIMED_OUT) timeouts++;
+        if (record->result == TEST_PASS) passed[slot]++;
+        else if (record->result == TEST_FAIL) failed[slot]++;
+        else errors[slot]++;
+    }
+    double took = elapsed_since(&start);
+
+    printf("%-8s %10s %10s %10s\n", "Periph", "Passed", "Failed", "Errors");
+    for (int slot = 0; slot < PERIPHERAL_COUNT; slot++) {
+        printf("%-8s %10zu %10zu %10zu\n", peripheral_name(peripheral_at(slot)), passed[slot], failed[slot], errors[slot]);
+    }
+    printf("%zu records (%zu timed out) scanned in %.3f ms\n", view->count, timeouts, took * 1000.0);
+    return 0;
+}
+
+static int open_index(log_index_t *idx, const char *path, const result_log_map_t *view)
+{
+    struct timespec start;
+
+    if (log_index_open(idx, path) < 0) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int added = log_index_update(idx, view);
+    if (added < 0) {
+        log_index_close(idx);
+        return -1;
+    }
+    if (added > 0) {
+        fprintf(stderr, "Indexed %d new records in %.3f ms\n", added, elapsed_since(&start) * 1000.0);
+    }
+    return 0;
+}
+
+static int build_index(const char *path, const result_log_map_t *view)
+{
+    log_index_t idx;
+
+    if (open_index(&idx, path, view) < 0) return -1;
+    printf("%s: %llu records, %llu ID slots, %llu time buckets of %d s\n", path,
+           (unsigned long long)idx.ids->indexed, (unsigned long long)idx.ids->slot_count,
+           (unsigned long long)idx.times->bucket_count, LOG_INDEX_BUCKET_SEC);
+    log_index_close(&idx);
+    return 0;
+}
+
+static int find_tests(const char *path, const result_log_map_t *view, char **ids, int count)
+{
+    size_t records[FIND_MAX_RECORDS];
+    log_index_t idx;
+    struct timespec start;
+    size_t matched = 0;
+
+    if (open_index(&idx, path, view) < 0) return -1;
+
+    result_log_print_header(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        char *end;
+        unsigned long test_id = strtoul(ids[i], &end, 0);
+        if (*ids[i] == '\0' || *end != '\0' || test_id > UINT32_MAX) {
+            printf("Invalid test ID: %s\n", ids[i]);
+            log_index_close(&idx);
+            return -1;
+        }
+
+        size_t found = log_index_find(&idx, (uint32_t)test_id, records, FIND_MAX_RECORDS);
+        if (found > FIND_MAX_RECORDS) found = FIND_MAX_RECORDS;
+        for (size_t k = 0; k < found; k++) {
+            if (records[k] < view->count) result_log_print_record(stdout, &view->records[records[k]]);
+        }
+        matched += found;
+    }
+    double took = elapsed_since(&start);
+
+    printf("%zu records for %d test IDs found in %.1f us\n", matched, count, took * 1e6);
+    log_index_close(&idx);
+    return 0;
+}
+
+// Parses "dd-mm-YYYY HH:MM:SS" (local time, like the text log) or "@seconds"
+static int parse_time(const char *text, int64_t *us)
+{
+    if (text[0] == '@') {
+        char *end;
+        double seconds = strtod(text + 1, &end);
+        if (end == text + 1 || *end != '\0') return -1;
+        *us = (int64_t)(seconds * 1e6);
+        return 0;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(text, LOG_TIME_FORMAT, &tm);
+    if (end == NULL || *end != '\0') return -1;
+    tm.tm_isdst = -1;
+    *us = (int64_t)mktime(&tm) * 1000000;
+    return 0;
+}
+
+static int print_range(const char *path, const result_log_map_t *view, const char *from_text, const char *to_text)
+{
+    static char out_buffer[1 << 16];
+    int64_t from_us, to_us;
+    size_t first, last, matched = 0, scanned = 0;
+    log_index_t idx;
+    struct timespec start;
+
+    if (parse_time(from_text, &from_us) < 0 || parse_time(to_text, &to_us) < 0) {
+        printf("Invalid time, expected \"%s\" or @seconds\n", LOG_TIME_FORMAT);
+        return -1;
+    }
+    if (open_index(&idx, path, view) < 0) return -1;
+
+    setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+    result_log_print_header(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (log_index_range(&idx, from_us, to_us, &first, &last) == 0) {
+        for (size_t i = first; i <= last && i < view->count; i++) {
+            const result_record_t *record = &view->records[i];
+            if (record->sent_us < from_us || record->sent_us > to_us) continue;
+            result_log_print_record(stdout, record);
+            matched++;
+        }
+        scanned = last - first + 1;
+    }
+    double took = elapsed_since(&start);
+
+    printf("%zu records in range (%zu scanned) in %.1f us\n", matched, scanned, took * 1e6);
+    log_index_close(&idx);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = RESULT_LOG_FILE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        switch (opt) {
+        case 'f': path = optarg; break;
+        default:
+            printf("Usage: %s [-f file] export|stats|index|find ID...|range FROM TO\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("Usage: %s [-f file] export|stats|index|find ID...|range FROM TO\n", argv[0]);
+        return 1;
+    }
+    const char *command = argv[optind];
+    int args = argc - optind - 1;
+
+    result_log_map_t view;
+    if (result_log_map(&view, path) < 0) return 1;
+
+    int status;
+    if (strcmp(command, "export") == 0 && args == 0) status = export_log(&view);
+    else if (strcmp(command, "stats") == 0 && args == 0) status = print_stats(&view);
+    else if (strcmp(command, "index") == 0 && args == 0) status = build_index(path, &view);
+    else if (strcmp(command, "find") == 0 && args > 0) status = find_tests(path, &view, argv + optind + 1, args);
+    else if (strcmp(command, "range") == 0 && args == 2) status = print_range(path, &view, argv[optind + 1], argv[optind + 2]);
+    else {
+        printf("Unknown command or wrong arguments: %s\n", command);
+        status = -1;
+    }
+
+    result_log_unmap(&view);
+    return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/**
+  * @brief Hands completed tests from the network threads to a dedicated logging thread
+  *
+  * The network threads only copy each outcome into their own lock-free ring; writing the
+  * log (text or binary), the histograms and the plan statistics happens on the logging
+  * thread. A slow disk then delays the log, not the commands in flight.
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "outcome_queue.h"
+
+#define OUTCOME_POP_BATCH   64      // outcomes taken from a ring per visit
+#define OUTCOME_IDLE_NS     100000  // sleep of the logging thread when every ring is empty
+
+/*
+ * @brief Pushes an outcome; waits while the ring is full. Usable as an outcome_cb (ctx: the ring).
+ */
+void outcome_ring_push(const test_outcome_t *outcome, void *ctx)
+{
+    outcome_ring_t *ring = ctx;
+    size_t tail = ring->tail;                   // Only this thread writes it
+
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == OUTCOME_RING_SIZE) {
+        ring->full_waits++;
+        while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == OUTCOME_RING_SIZE) sched_yield();
+    }
+    ring->slots[tail & (OUTCOME_RING_SIZE - 1)] = *outcome;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// The producer is done: the logging thread stops once it drained the ring
+void outcome_ring_close(outcome_ring_t *ring)
+{
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+// Hands up to OUTCOME_POP_BATCH outcomes of a ring to the sink
+static size_t outcome_ring_drain(outcome_queue_t *queue, outcome_ring_t *ring)
+{
+    size_t head = ring->head;                   // Only this thread writes it
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t n = tail - head;
+
+    if (n > queue->max_backlog) queue->max_backlog = n;
+    if (n > OUTCOME_POP_BATCH) n = OUTCOME_POP_BATCH;
+    for (size_t k = 0; k < n; k++) {
+        queue->sink(&ring->slots[(head + k) & (OUTCOME_RING_SIZE - 1)], queue->ctx);
+    }
+    // Release the slots only after the sink is done reading them
+    __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+    queue->logged += n;
+    return n;
+}
+
+static void *outcome_queue_main(void *arg)
+{
+    outcome_queue_t *queue = arg;
+    const struct timespec idle = {0, OUTCOME_IDLE_NS};
+
+    for (;;) {
+        size_t taken = 0, open = 0;
+
+        for (size_t i = 0; i < queue->count; i++) {
+            outcome_ring_t *ring = &queue->rings[i];
+            // Read closed before draining: a ring closed and then found empty is really done
+            int closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+            size_t n = outcome_ring_drain(queue, ring);
+            taken += n;
+            if (!closed || n > 0) open++;
+        }
+        if (open == 0) return NULL;
+        if (taken == 0) nanosleep(&idle, NULL);
+    }
+}
+
+/*
+ * @brief Starts the logging thread with one ring per network thread.
+ * @param sink: Called for every outcome, on the logging thread.
+ * @retval 0 on success, -1 on failure.
+ */
+int outcome_queue_start(outcome_queue_t *queue, size_t producers, outcome_cb sink, void *ctx)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->rings = aligned_alloc(OUTCOME_CACHE_LINE, producers * sizeof(outcome_ring_t));
+    if (queue->rings == NULL) {
+        perror("Error: Could not allocate the outcome rings");
+        return -1;
+    }
+    memset(queue->rings, 0, producers * sizeof(outcome_ring_t));
+    queue->count = producers;
+    queue->sink = sink;
+    queue->ctx = ctx;
+
+    int err = pthread_create(&queue->thread, NULL, outcome_queue_main, queue);
+    if (err != 0) {
+        printf("Error: Could not start the logging thread: %s\n", strerror(err));
+        free(queue->rings);
+        queue->rings = NULL;
+        return -1;
+    }
+    queue->running = 1;
+    return 0;
+}
+
+outcome_ring_t *outcome_queue_ring(outcome_queue_t *queue, size_t producer)
+{
+    return &queue->rings[producer];
+}
+
+/*
+ * @brief Closes every ring, waits until the logging thread logged everything and frees the rings.
+ * @retval 0 on success, -1 if the thread could not be joined.
+ */
+int outcome_queue_stop(outcome_queue_t *queue)
+{
+    int status = 0;
+
+    if (queue->running) {
+        for (size_t i = 0; i < queue->count; i++) outcome_ring_close(&queue->rings[i]);
+        if (pthread_join(queue->thread, NULL) != 0) status = -1;
+        queue->running = 0;
+    }
+    for (size_t i = 0; i < queue->count && queue->rings != NULL; i++) queue->full_waits += queue->rings[i].full_waits;
+    free(queue->rings);
+    queue->rings = NULL;
+    return status;
+}
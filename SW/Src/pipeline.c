@@ -0,0 +1,974 @@
+/**
+  * @brief Pipelined command/result exchange with a single UUT
+  *
+  * Keeps up to `window` commands in flight on one socket. Commands waiting for their
+  * result are kept in a small open addressing table keyed by test_id, so results are
+  * matched in whatever order the UUT sends them back.
+  *
+  * With batch_io the datagrams are sent and received PIPELINE_BATCH at a time through
+  * sendmmsg()/recvmmsg() instead of one sendto()/recvfrom() each. With io_uring the sends
+  * are queued on a ring and results arrive through a multishot receive (see uring.h).
+  *
+  * With frame_commands several compact commands share one COMMAND_BATCH_TAG datagram; the UUT
+  * then may answer with RESULT_BATCH_TAG frames, which every receive path takes apart.
+  * With tlv every command is encoded as a TLV_MSG_COMMAND frame (see tlv.h); the replies
+  * are the same as to a plain command. The frame also carries the priority and the deadline
+  * of the command, by which the UUT orders its queue, and the limits of a soak. A soak is
+  * answered with a TLV_MSG_SOAK_RESULT, and its resends wait out its duration first.
+  *
+  * An EXTENDED_RESULT command may be answered with a result_ext_t, handed on with its outcome.
+  * Progress frames of STREAM_PROGRESS commands go to on_progress. A test that reports progress
+  * is alive, so its resend is put off by another timeout.
+  */
+#define _GNU_SOURCE             // sendmmsg(), recvmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "pipeline.h"
+
+// Low bits of a ring entry's user_data: which operation of the pipeline it belongs to
+#define RING_OP_MASK    3
+#define RING_OP_SEND    1
+#define RING_OP_RECV    2
+
+struct pipeline_batch_t {
+    struct mmsghdr msgs[PIPELINE_BATCH];
+    struct iovec iovs[PIPELINE_BATCH];
+    unsigned char results[PIPELINE_BATCH][RESULT_FRAME_SIZE];
+    struct sockaddr_in from[PIPELINE_BATCH];
+    char control[PIPELINE_BATCH][PIPELINE_CONTROL_LEN];
+};
+
+/*
+ * @brief Seconds on the monotonic clock: durations and deadlines are immune to NTP steps.
+ */
+double time_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+static unsigned inflight_home(uint32_t test_id, unsigned mask)
+{
+    return (test_id * 2654435761u) & mask;
+}
+
+static inflight_t *inflight_find(pipeline_t *pl, uint32_t test_id)
+{
+    unsigned i = inflight_home(test_id, pl->table_mask);
+
+    while (pl->table[i].used) {
+        if (pl->table[i].test_id == test_id) return &pl->table[i];
+        i = (i + 1) & pl->table_mask;
+    }
+    return NULL;
+}
+
+static inflight_t *inflight_insert(pipeline_t *pl, uint32_t test_id)
+{
+    unsigned i = inflight_home(test_id, pl->table_mask);
+
+    while (pl->table[i].used) i = (i + 1) & pl->table_mask;
+
+    pl->table[i].used = 1;
+    pl->table[i].test_id = test_id;
+    return &pl->table[i];
+}
+
+// Backward shift deletion: keeps every probe sequence intact without tombstones
+static void inflight_remove(pipeline_t *pl, inflight_t *entry)
+{
+    unsigned mask = pl->table_mask;
+    unsigned hole = (unsigned)(entry - pl->table);
+    unsigned i = (hole + 1) & mask;
+
+    while (pl->table[i].used) {
+        unsigned home = inflight_home(pl->table[i].test_id, mask);
+        // The entry may fill the hole only if the hole lies on its probe path
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            pl->table[hole] = pl->table[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    pl->table[hole].used = 0;
+}
+
+static double ts_to_sec(const struct timespec *ts)
+{
+    return ts->tv_sec + (double)ts->tv_nsec / 1000000000.0;
+}
+
+/*
+ * @brief Asks the kernel to timestamp every datagram of the socket.
+ * Prefers SO_TIMESTAMPING (software stamps of both directions) and falls back to SO_TIMESTAMPNS
+ * (receive side only). Hardware stamps are left alone: they count on the NIC's own clock, which
+ * cannot be compared with CLOCK_REALTIME, and need the NIC configured through SIOCSHWTSTAMP.
+ * @retval The TIMESTAMPS_* mode in effect.
+ */
+static int pipeline_enable_timestamps(int sockfd)
+{
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    int on = 1;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) return TIMESTAMPS_FULL;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0) return TIMESTAMPS_RX_ONLY;
+    perror("Warning: Kernel timestamps are not available");
+    return TIMESTAMPS_OFF;
+}
+
+// The software stamp (CLOCK_REALTIME) of an SCM_TIMESTAMPING or SCM_TIMESTAMPNS message
+static int read_timestamp(struct msghdr *msg, struct timespec *ts)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            const struct timespec *stamps = (const struct timespec *)CMSG_DATA(cmsg);
+            *ts = stamps[0];
+            return ts->tv_sec || ts->tv_nsec;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Prepares a pipeline over an already created (and bound) UDP socket.
+ * @param pl: The pipeline to initialize.
+ * @param sockfd: UDP socket to send and receive on.
+ * @param uut: Address of the UUT.
+ * @param commands: The commands to run, each with a unique test_id. Must outlive the pipeline.
+ * @param count: Number of commands.
+ * @param cfg: Window, timeout and measurement options.
+ * @param on_outcome: Called once for every command (may be NULL).
+ * @param ctx: Passed to on_outcome.
+ * @retval 0 on success, -1 on allocation failure.
+ */
+int pipeline_init(pipeline_t *pl, int sockfd, const struct sockaddr_in *uut,
+                  const test_command_t *commands, size_t count,
+                  const pipeline_config_t *cfg, outcome_cb on_outcome, void *ctx)
+{
+    unsigned size = 2;
+    unsigned window = cfg->window;
+
+    memset(pl, 0, sizeof(*pl));
+    if (window < 1) window = 1;
+    if (window > PIPELINE_MAX_WINDOW) window = PIPELINE_MAX_WINDOW;
+
+    // Keep the table at most half full
+    while (size < 2 * window) size <<= 1;
+
+    pl->table = calloc(size, sizeof(inflight_t));
+    if (pl->table == NULL) {
+        perror("Error: Could not allocate the in-flight table");
+        return -1;
+    }
+    pl->table_mask = size - 1;
+    pl->sockfd = sockfd;
+    pl->uut = *uut;
+    pl->commands = commands;
+    pl->count = count;
+    pl->window = window;
+    pl->timeout_ms = cfg->timeout_ms;
+    pl->retries = cfg->retries;
+    pl->compact = cfg->compact;
+    if (cfg->tlv) {
+        // Encoded one at a time into the frame buffer
+        pl->tlv = 1;
+        pl->priority = cfg->priority;
+        pl->soak_iterations = cfg->soak_iterations;
+        pl->soak_ms = cfg->soak_ms;
+        pl->frame = malloc(TLV_FRAME_MAX);
+        if (pl->frame == NULL) {
+            perror("Error: Could not allocate the TLV frame");
+            pipeline_free(pl);
+            return -1;
+        }
+    }
+    else if (cfg->frame_commands > 0) {
+        // Frames carry compact commands only, a resend goes out on its own
+        pl->frame_commands = cfg->frame_commands < COMMAND_BATCH_MAX ? cfg->frame_commands : COMMAND_BATCH_MAX;
+        pl->compact = 1;
+        pl->frame = malloc(BATCH_FRAME_MAX);
+        if (pl->frame == NULL) {
+            perror("Error: Could not allocate the batch frame");
+            pipeline_free(pl);
+            return -1;
+        }
+    }
+    pl->rate = cfg->rate;
+    pl->on_outcome = on_outcome;
+    pl->ctx = ctx;
+    if (cfg->kernel_timestamps) pl->timestamping = pipeline_enable_timestamps(sockfd);
+    if (cfg->io_uring && pl->timestamping != TIMESTAMPS_OFF) {
+        printf("Warning: Kernel timestamps need the plain socket calls, io_uring is not used\n");
+    }
+    else if (cfg->io_uring) {
+        uring_t *ring = uring_create(URING_ENTRIES);
+        if (ring != NULL) {
+            pl->own_ring = 1;
+            if (pipeline_use_ring(pl, ring) < 0) {
+                pipeline_free(pl);
+                return -1;
+            }
+        }
+    }
+    if (cfg->batch_io && pl->ring == NULL) {
+        pl->batch = malloc(sizeof(pipeline_batch_t));
+        if (pl->batch == NULL) {
+            perror("Error: Could not allocate the message vectors");
+            pipeline_free(pl);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Gives every command its own deadline: the test is reported as timed out once it
+ * passes, whatever resends are left.
+ * @param deadlines_ms: One value per command (0 - no deadline). Must outlive the pipeline.
+ */
+void pipeline_set_deadlines(pipeline_t *pl, const unsigned *deadlines_ms)
+{
+    pl->deadlines_ms = deadlines_ms;
+}
+
+/*
+ * @brief Hands the progress frames of STREAM_PROGRESS commands to on_progress (with the pipeline's ctx).
+ */
+void pipeline_set_progress(pipeline_t *pl, progress_cb on_progress)
+{
+    pl->on_progress = on_progress;
+}
+
+static int pipeline_arm_receive(pipeline_t *pl)
+{
+    struct io_uring_sqe *sqe = uring_sqe(pl->ring);
+    if (sqe == NULL) return -1;
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = pl->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)&pl->ring_msg;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)pl | RING_OP_RECV;
+    return 0;
+}
+
+/*
+ * @brief Moves the pipeline's socket I/O onto an io_uring (shared by the pipelines of a fleet).
+ * Results are then handed to the pipeline by pipeline_reap().
+ * @retval 0 on success, -1 if the receive could not be queued.
+ */
+int pipeline_use_ring(pipeline_t *pl, uring_t *ring)
+{
+    pl->ring = ring;
+    memset(&pl->ring_msg, 0, sizeof(pl->ring_msg));
+    pl->ring_msg.msg_namelen = sizeof(struct sockaddr_in);
+    return pipeline_arm_receive(pl);
+}
+
+void pipeline_config_default(pipeline_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->window = PIPELINE_DEFAULT_WINDOW;
+    cfg->timeout_ms = PIPELINE_DEFAULT_TIMEOUT;
+    cfg->retries = PIPELINE_DEFAULT_RETRIES;
+}
+
+void pipeline_free(pipeline_t *pl)
+{
+    free(pl->table);
+    pl->table = NULL;
+    free(pl->batch);
+    pl->batch = NULL;
+    free(pl->frame);
+    pl->frame = NULL;
+    if (pl->own_ring) uring_free(pl->ring);
+    pl->ring = NULL;
+    pl->own_ring = 0;
+}
+
+static void pipeline_complete(pipeline_t *pl, inflight_t *entry, result_pro_t result, int timed_out,
+                              const struct timespec *rx_kernel, const result_ext_t *detail,
+                              const tlv_soak_result_t *soak)
+{
+    test_outcome_t outcome;
+
+    outcome.command = &pl->commands[entry->index];
+    outcome.result = result;
+    outcome.sent = entry->sent;
+    outcome.duration = time_now() - entry->sent_at;
+    outcome.kernel_duration = -1;
+    outcome.timed_out = timed_out;
+    outcome.extended = detail != NULL;
+    if (detail != NULL) outcome.detail = *detail;
+    outcome.soaked = soak != NULL;
+    if (soak != NULL) outcome.soak = *soak;
+
+    if (rx_kernel != NULL) {
+        // Both kernel stamps are CLOCK_REALTIME; without a send stamp use the user space send time
+        double tx = (entry->tx_kernel.tv_sec || entry->tx_kernel.tv_nsec) ?
+                    ts_to_sec(&entry->tx_kernel) : entry->sent.tv_sec + entry->sent.tv_usec / 1000000.0;
+        outcome.kernel_duration = ts_to_sec(rx_kernel) - tx;
+    }
+
+    if (timed_out) pl->timeouts++;
+    else if (result.test_result == TEST_PASS) pl->passed++;
+    else if (result.test_result == TEST_FAIL) pl->failed++;
+    else pl->errors++;
+
+    inflight_remove(pl, entry);
+    pl->in_flight--;
+    pl->completed++;
+
+    if (pl->on_outcome) pl->on_outcome(&outcome, pl->ctx);
+}
+
+// Bytes of a command on the wire
+static size_t command_size(const pipeline_t *pl, const test_command_t *cmd)
+{
+    return pl->compact ? TEST_COMMAND_SIZE(cmd) : sizeof(*cmd);
+}
+
+// Queues the send of a command on the ring, submitted with the next wait. Only failures complete
+static int pipeline_queue_send(pipeline_t *pl, const test_command_t *cmd)
+{
+    struct io_uring_sqe *sqe = uring_sqe(pl->ring);
+    if (sqe == NULL) return -1;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = pl->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)cmd;
+    sqe->len = (uint32_t)command_size(pl, cmd);
+    sqe->addr2 = (uint64_t)(uintptr_t)&pl->uut;
+    sqe->addr_len = sizeof(pl->uut);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = (uint64_t)(uintptr_t)pl | RING_OP_SEND;
+    pl->bytes_sent += sqe->len;
+    return 0;
+}
+
+// sendto() of one command, retried when interrupted
+static int pipeline_send(pipeline_t *pl, const test_command_t *cmd)
+{
+    const void *data = cmd;
+    size_t len = command_size(pl, cmd);
+
+    if (pl->tlv) {
+        // Sent right away even on a ring: the frame buffer is reused for the next one
+        tlv_sched_t sched = {.priority = pl->priority, .deadline_ms = 0,
+                             .soak_iterations = pl->soak_iterations, .soak_ms = pl->soak_ms};
+        if (pl->deadlines_ms != NULL) sched.deadline_ms = pl->deadlines_ms[cmd - pl->commands];
+        len = tlv_encode_command(pl->frame, TLV_FRAME_MAX, cmd, &sched);
+        if (len == 0) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        data = pl->frame;
+    }
+    else if (pl->ring != NULL) {
+        return pipeline_queue_send(pl, cmd);
+    }
+
+    for (;;) {
+        pl->syscalls++;
+        ssize_t sent_bytes = sendto(pl->sockfd, data, len, 0, (const struct sockaddr *)&pl->uut, sizeof(pl->uut));
+        if (sent_bytes >= 0) {
+            pl->bytes_sent += sent_bytes;
+            return 0;
+        }
+        if (errno != EINTR) return -1;
+    }
+}
+
+// Wait before resending for the given attempt: timeout_ms doubled per resend, after the soak duration.
+// Only the doubled waits are capped, a timeout above PIPELINE_MAX_BACKOFF is kept as given.
+static double pipeline_backoff(const pipeline_t *pl, unsigned attempts)
+{
+    double wait_ms = pl->timeout_ms;
+    double cap = pl->timeout_ms > PIPELINE_MAX_BACKOFF ? pl->timeout_ms : PIPELINE_MAX_BACKOFF;
+
+    while (attempts-- > 0 && wait_ms < cap) wait_ms *= 2;
+    if (wait_ms > cap) wait_ms = cap;
+    // A soak answers no sooner than its duration, a resend only finds it still pending
+    return (wait_ms + pl->soak_ms) / 1000.0;
+}
+
+// Starts waiting for the result of the next command, which was just sent
+static inflight_t *pipeline_track(pipeline_t *pl)
+{
+    const test_command_t *cmd = &pl->commands[pl->next];
+    inflight_t *entry = inflight_insert(pl, cmd->test_id);
+    entry->index = (uint32_t)pl->next;
+    gettimeofday(&entry->sent, NULL);
+    entry->sent_at = time_now();
+    entry->deadline = entry->sent_at + pipeline_backoff(pl, 0);
+    entry->give_up = 0;
+    if (pl->deadlines_ms != NULL && pl->deadlines_ms[pl->next] > 0) {
+        entry->give_up = entry->sent_at + pl->deadlines_ms[pl->next] / 1000.0;
+        if (entry->give_up < entry->deadline) entry->deadline = entry->give_up;
+    }
+    entry->attempts = 0;
+    entry->tx_seq = pl->tx_seq++;
+    entry->tx_kernel.tv_sec = 0;
+    entry->tx_kernel.tv_nsec = 0;
+
+    pl->next++;
+    pl->in_flight++;
+    if (pl->rate > 0) pl->next_send_at += 1.0 / pl->rate;
+    return entry;
+}
+
+// Commands the pacing allows to send now (open loop: a late schedule catches up at once)
+static size_t pipeline_due(pipeline_t *pl)
+{
+    if (pl->rate <= 0) return pl->count - pl->next;
+
+    double now = time_now();
+    if (pl->next_send_at == 0) pl->next_send_at = now;
+    if (now < pl->next_send_at) return 0;
+    return (size_t)((now - pl->next_send_at) * pl->rate) + 1;
+}
+
+// Sends up to PIPELINE_BATCH commands per sendmmsg() until the window is full
+static int pipeline_fill_batch(pipeline_t *pl)
+{
+    pipeline_batch_t *batch = pl->batch;
+
+    while (pl->in_flight < pl->window && pl->next < pl->count) {
+        size_t n = pl->window - pl->in_flight;
+        size_t due = pipeline_due(pl);
+        if (n > pl->count - pl->next) n = pl->count - pl->next;
+        if (n > due) n = due;
+        if (n > PIPELINE_BATCH) n = PIPELINE_BATCH;
+        if (n == 0) break;
+
+        for (size_t k = 0; k < n; k++) {
+            batch->iovs[k].iov_base = (void *)&pl->commands[pl->next + k];
+            batch->iovs[k].iov_len = command_size(pl, &pl->commands[pl->next + k]);
+            memset(&batch->msgs[k].msg_hdr, 0, sizeof(struct msghdr));
+            batch->msgs[k].msg_hdr.msg_name = &pl->uut;
+            batch->msgs[k].msg_hdr.msg_namelen = sizeof(pl->uut);
+            batch->msgs[k].msg_hdr.msg_iov = &batch->iovs[k];
+            batch->msgs[k].msg_hdr.msg_iovlen = 1;
+        }
+
+        pl->syscalls++;
+        int sent = sendmmsg(pl->sockfd, batch->msgs, n, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            perror("sendmmsg failed");
+            return -1;
+        }
+        for (int k = 0; k < sent; k++) {
+            pl->bytes_sent += batch->iovs[k].iov_len;
+            pipeline_track(pl);
+        }
+    }
+    return 0;
+}
+
+// Packs up to frame_commands due commands per COMMAND_BATCH_TAG datagram until the window is full
+static int pipeline_fill_frames(pipeline_t *pl)
+{
+    batch_header_t header = {.tag = COMMAND_BATCH_TAG};
+
+    while (pl->in_flight < pl->window && pl->next < pl->count) {
+        size_t n = pl->window - pl->in_flight;
+        size_t due = pipeline_due(pl);
+        if (n > pl->count - pl->next) n = pl->count - pl->next;
+        if (n > due) n = due;
+        if (n > pl->frame_commands) n = pl->frame_commands;
+        if (n == 0) break;
+
+        size_t len = BATCH_HEADER_SIZE;
+        header.count = 0;
+        while (header.count < n) {
+            const test_command_t *cmd = &pl->commands[pl->next + header.count];
+            if (len + TEST_COMMAND_SIZE(cmd) > BATCH_FRAME_MAX) break;
+            memcpy(pl->frame + len, cmd, TEST_COMMAND_SIZE(cmd));
+            len += TEST_COMMAND_SIZE(cmd);
+            header.count++;
+        }
+        memcpy(pl->frame, &header, BATCH_HEADER_SIZE);
+
+        // Sent right away even on a ring: the frame buffer is reused for the next one
+        pl->syscalls++;
+        ssize_t sent_bytes = sendto(pl->sockfd, pl->frame, len, 0, (const struct sockaddr *)&pl->uut, sizeof(pl->uut));
+        if (sent_bytes < 0) {
+            if (errno == EINTR) continue;
+            perror("sendto failed");
+            return -1;
+        }
+        pl->bytes_sent += sent_bytes;
+
+        // One datagram, so one send timestamp for all of its commands
+        uint32_t seq = pl->tx_seq;
+        for (uint8_t k = 0; k < header.count; k++) pipeline_track(pl)->tx_seq = seq;
+        pl->tx_seq = seq + 1;
+    }
+    return 0;
+}
+
+/*
+ * @brief Sends commands until the window is full or every command was sent.
+ * @retval 0 on success, -1 on a socket error.
+ */
+int pipeline_fill(pipeline_t *pl)
+{
+    if (pl->frame_commands > 0) return pipeline_fill_frames(pl);
+    if (pl->batch != NULL && !pl->tlv) return pipeline_fill_batch(pl);
+
+    // On a ring the sends are only queued here
+    while (pl->in_flight < pl->window && pl->next < pl->count && pipeline_due(pl) > 0) {
+        if (pipeline_send(pl, &pl->commands[pl->next]) < 0) {
+            perror("sendto failed");
+            return -1;
+        }
+        pipeline_track(pl);
+    }
+    return 0;
+}
+
+// Matches the send timestamps on the socket's error queue to the commands in flight
+static void pipeline_read_tx_timestamps(pipeline_t *pl)
+{
+    char control[PIPELINE_CONTROL_LEN];
+    char data[64];
+
+    for (;;) {
+        struct iovec iov = {.iov_base = data, .iov_len = sizeof(data)};
+        struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1,
+                             .msg_control = control, .msg_controllen = sizeof(control)};
+        struct timespec ts;
+        int have_seq = 0;
+        uint32_t seq = 0;
+
+        pl->syscalls++;
+        if (recvmsg(pl->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)) {
+                const struct sock_extended_err *err = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+                if (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                    seq = err->ee_data;
+                    have_seq = 1;
+                }
+            }
+        }
+        if (!have_seq || !read_timestamp(&msg, &ts)) continue;
+
+        // Commands sharing a batch frame share its timestamp
+        for (unsigned i = 0; i <= pl->table_mask; i++) {
+            if (pl->table[i].used && pl->table[i].tx_seq == seq) pl->table[i].tx_kernel = ts;
+        }
+    }
+}
+
+// recvfrom() that also returns the kernel receive timestamp when timestamping is on
+static ssize_t pipeline_recv(pipeline_t *pl, void *data, size_t size, struct sockaddr_in *from,
+                             struct timespec *rx_kernel, int *have_rx_kernel)
+{
+    char control[PIPELINE_CONTROL_LEN];
+    struct iovec iov = {.iov_base = data, .iov_len = size};
+    struct msghdr msg = {.msg_name = from, .msg_namelen = sizeof(*from), .msg_iov = &iov, .msg_iovlen = 1,
+                         .msg_control = control, .msg_controllen = sizeof(control)};
+
+    *have_rx_kernel = 0;
+    pl->syscalls++;
+    if (pl->timestamping == TIMESTAMPS_OFF) {
+        socklen_t addr_len = sizeof(*from);
+        return recvfrom(pl->sockfd, data, size, MSG_DONTWAIT,
+                        (struct sockaddr *)from, &addr_len);
+    }
+
+    ssize_t n = recvmsg(pl->sockfd, &msg, MSG_DONTWAIT);
+    if (n >= 0) *have_rx_kernel = read_timestamp(&msg, rx_kernel);
+    return n;
+}
+
+// Completes the command a result belongs to
+static void pipeline_accept_result(pipeline_t *pl, const result_pro_t *result_pack, const struct timespec *rx_kernel,
+                                   const result_ext_t *detail, const tlv_soak_result_t *soak)
+{
+    inflight_t *entry = inflight_find(pl, result_pack->test_id);
+    if (entry == NULL) {
+        // Late reply to a timed out command, or a rejection without a test ID
+        pl->stray++;
+        return;
+    }
+    pipeline_complete(pl, entry, *result_pack, 0, rx_kernel, detail, soak);
+}
+
+// A PROGRESS_TAG frame: the test is still running
+static void pipeline_accept_progress(pipeline_t *pl, const unsigned char *data, ssize_t n)
+{
+    progress_header_t header;
+
+    memcpy(&header, data, sizeof(header));
+    if ((size_t)n < sizeof(header) + header.batch.count * sizeof(progress_record_t)) {
+        pl->stray++;
+        return;
+    }
+    pl->progress_frames++;
+
+    inflight_t *entry = inflight_find(pl, header.test_id);
+    if (entry == NULL) return;      // Its result came first
+
+    double now = time_now();
+    entry->deadline = now + pipeline_backoff(pl, entry->attempts);
+    if (entry->give_up > 0 && entry->give_up < entry->deadline) entry->deadline = entry->give_up;
+
+    if (pl->on_progress != NULL && header.batch.count > 0) {
+        test_progress_t progress;
+        progress.command = &pl->commands[entry->index];
+        progress.iterations = header.iterations;
+        progress.records = (const progress_record_t *)(data + sizeof(header));
+        progress.count = header.batch.count;
+        pl->on_progress(&progress, pl->ctx);
+    }
+}
+
+// Completes the commands of a received datagram: one result or a RESULT_BATCH_TAG frame of them
+static void pipeline_accept(pipeline_t *pl, const unsigned char *data, ssize_t n,
+                            const struct sockaddr_in *from, const struct timespec *rx_kernel)
+{
+    batch_header_t header = {0};
+    result_pro_t result_pack;
+
+    if (n < (ssize_t)sizeof(result_pack) ||
+        from->sin_addr.s_addr != pl->uut.sin_addr.s_addr || from->sin_port != pl->uut.sin_port) {
+        pl->stray++;
+        return;
+    }
+
+    memcpy(&header, data, BATCH_HEADER_SIZE);
+    if (header.tag == PROGRESS_TAG) {
+        pipeline_accept_progress(pl, data, n);
+        return;
+    }
+    if (header.tag == RESULT_EXT_TAG) {
+        result_ext_t detail;
+        if ((size_t)n < sizeof(detail)) {
+            pl->stray++;
+            return;
+        }
+        memcpy(&detail, data, sizeof(detail));
+        result_pack.test_id = detail.test_id;
+        result_pack.test_result = detail.test_result;
+        pipeline_accept_result(pl, &result_pack, rx_kernel, &detail, NULL);
+        return;
+    }
+    if (header.tag == TLV_TAG) {
+        tlv_soak_result_t soak;
+        if (tlv_decode_soak_result(data, (uint16_t)n, &soak) < 0) {
+            pl->stray++;
+            return;
+        }
+        result_pack.test_id = soak.test_id;
+        result_pack.test_result = soak.result;
+        pipeline_accept_result(pl, &result_pack, rx_kernel, NULL, &soak);
+        return;
+    }
+    if (header.tag != RESULT_BATCH_TAG) {
+        memcpy(&result_pack, data, sizeof(result_pack));
+        pipeline_accept_result(pl, &result_pack, rx_kernel, NULL, NULL);
+        return;
+    }
+    if ((size_t)n < BATCH_HEADER_SIZE + header.count * sizeof(result_pack)) {
+        pl->stray++;
+        return;
+    }
+    for (uint8_t k = 0; k < header.count; k++) {
+        memcpy(&result_pack, data + BATCH_HEADER_SIZE + k * sizeof(result_pack), sizeof(result_pack));
+        pipeline_accept_result(pl, &result_pack, rx_kernel, NULL, NULL);
+    }
+}
+
+// Reaps up to PIPELINE_BATCH results per recvmmsg() until the socket is empty
+static int pipeline_drain_batch(pipeline_t *pl)
+{
+    pipeline_batch_t *batch = pl->batch;
+    struct timespec rx_kernel;
+
+    for (;;) {
+        if (pl->timestamping == TIMESTAMPS_FULL) pipeline_read_tx_timestamps(pl);
+
+        for (int k = 0; k < PIPELINE_BATCH; k++) {
+            batch->iovs[k].iov_base = batch->results[k];
+            batch->iovs[k].iov_len = RESULT_FRAME_SIZE;
+            memset(&batch->msgs[k].msg_hdr, 0, sizeof(struct msghdr));
+            batch->msgs[k].msg_hdr.msg_name = &batch->from[k];
+            batch->msgs[k].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            batch->msgs[k].msg_hdr.msg_iov = &batch->iovs[k];
+            batch->msgs[k].msg_hdr.msg_iovlen = 1;
+            if (pl->timestamping != TIMESTAMPS_OFF) {
+                batch->msgs[k].msg_hdr.msg_control = batch->control[k];
+                batch->msgs[k].msg_hdr.msg_controllen = PIPELINE_CONTROL_LEN;
+            }
+        }
+
+        pl->syscalls++;
+        int n = recvmmsg(pl->sockfd, batch->msgs, PIPELINE_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            perror("Receive failed");
+            return -1;
+        }
+
+        for (int k = 0; k < n; k++) {
+            int have_rx_kernel = pl->timestamping != TIMESTAMPS_OFF &&
+                                 read_timestamp(&batch->msgs[k].msg_hdr, &rx_kernel);
+            pipeline_accept(pl, batch->results[k], batch->msgs[k].msg_len, &batch->from[k],
+                            have_rx_kernel ? &rx_kernel : NULL);
+        }
+        // A short batch emptied the socket: no need for a call that only returns EAGAIN
+        if (n < PIPELINE_BATCH) return 0;
+    }
+}
+
+// Takes the results out of a multishot receive buffer
+static void pipeline_accept_buffer(pipeline_t *pl, const struct io_uring_cqe *cqe)
+{
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const unsigned char *buffer = uring_buffer(pl->ring, bid);
+    const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+    const unsigned char *payload = buffer + sizeof(*out) + pl->ring_msg.msg_namelen + pl->ring_msg.msg_controllen;
+    struct sockaddr_in from;
+
+    memset(&from, 0, sizeof(from));
+    memcpy(&from, buffer + sizeof(*out), out->namelen < sizeof(from) ? out->namelen : sizeof(from));
+    if (out->flags & MSG_TRUNC) {
+        pl->stray++;
+    }
+    else {
+        pipeline_accept(pl, payload, out->payloadlen, &from, NULL);
+    }
+    uring_recycle(pl->ring, bid);
+}
+
+/*
+ * @brief Handles every completion posted on a ring: results go to the pipelines they belong to,
+ * multishot receives that ended are queued again.
+ * @retval 0 on success, -1 on a receive error.
+ */
+int pipeline_reap(uring_t *ring)
+{
+    struct io_uring_cqe *cqe;
+    int status = 0;
+
+    while ((cqe = uring_peek(ring)) != NULL) {
+        pipeline_t *pl = (pipeline_t *)(uintptr_t)(cqe->user_data & ~(uint64_t)RING_OP_MASK);
+        unsigned op = cqe->user_data & RING_OP_MASK;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+
+        if (cqe->user_data == URING_TIMER) {
+            // The wait ended, nothing to do
+        }
+        else if (op == RING_OP_SEND) {
+            // The command is resent when its result does not show up
+            errno = -res;
+            perror("io_uring send failed");
+        }
+        else if (op == RING_OP_RECV && res >= 0) {
+            pipeline_accept_buffer(pl, cqe);
+        }
+        else if (op == RING_OP_RECV && res != -ENOBUFS) {
+            errno = -res;
+            perror("Receive failed");
+            status = -1;
+        }
+        uring_seen(ring);
+
+        // Out of buffers (they are back by now) or otherwise finished: start receiving again
+        if (op == RING_OP_RECV && !(flags & IORING_CQE_F_MORE) && status == 0 && pipeline_arm_receive(pl) < 0) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+/*
+ * @brief Reads every result currently queued on the socket without blocking.
+ * @retval 0 on success, -1 on a socket error.
+ */
+int pipeline_drain(pipeline_t *pl)
+{
+    unsigned char frame[RESULT_FRAME_SIZE];
+    struct sockaddr_in from;
+    struct timespec rx_kernel;
+    int have_rx_kernel;
+
+    if (pl->batch != NULL) return pipeline_drain_batch(pl);
+
+    for (;;) {
+        // Send stamps are queued right after the send, so take them before the replies
+        if (pl->timestamping == TIMESTAMPS_FULL) pipeline_read_tx_timestamps(pl);
+
+        ssize_t n = pipeline_recv(pl, frame, sizeof(frame), &from, &rx_kernel, &have_rx_kernel);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            perror("Receive failed");
+            return -1;
+        }
+        pipeline_accept(pl, frame, n, &from, have_rx_kernel ? &rx_kernel : NULL);
+    }
+}
+
+/*
+ * @brief Resends every command whose deadline has passed, waiting twice as long each time.
+ * Commands out of resends are given up on and reported as TEST_ERR. A soak bounded only by its
+ * iteration count runs for a time nobody knows beforehand and reports no progress, so it is
+ * resent (every PIPELINE_MAX_BACKOFF at most) until it answers or its plan deadline passes.
+ */
+void pipeline_expire(pipeline_t *pl, double now)
+{
+    unsigned i = 0;
+    int open_ended = pl->soak_iterations > 0 && pl->soak_ms == 0;
+
+    while (i <= pl->table_mask && pl->in_flight > 0) {
+        inflight_t *entry = &pl->table[i];
+        if (entry->used && entry->deadline <= now && (entry->attempts < pl->retries || open_ended) &&
+            (entry->give_up == 0 || now < entry->give_up)) {
+            // The UUT answers a resent test_id from its result cache, so this never runs a test twice
+            if (entry->attempts < UINT8_MAX) entry->attempts++;
+            entry->deadline = now + pipeline_backoff(pl, entry->attempts);
+            if (entry->give_up > 0 && entry->give_up < entry->deadline) entry->deadline = entry->give_up;
+            if (pipeline_send(pl, &pl->commands[entry->index]) < 0) {
+                perror("Resend failed");
+            }
+            else {
+                entry->tx_seq = pl->tx_seq++;
+                entry->tx_kernel.tv_sec = 0;
+                entry->tx_kernel.tv_nsec = 0;
+                pl->retransmits++;
+            }
+        }
+        else if (entry->used && entry->deadline <= now) {
+            result_pro_t result = {entry->test_id, TEST_ERR};
+            // Removal may shift another entry into this slot, so look at it again
+            pipeline_complete(pl, entry, result, 1, NULL, NULL, NULL);
+            continue;
+        }
+        i++;
+    }
+}
+
+/*
+ * @brief Millis until the nearest deadline of a command in flight (or the next paced send),
+ * -1 if there is nothing to wait for.
+ */
+int pipeline_next_timeout(const pipeline_t *pl, double now)
+{
+    double nearest = -1;
+
+    if (pl->rate > 0 && pl->next < pl->count && pl->in_flight < pl->window) nearest = pl->next_send_at;
+
+    for (unsigned i = 0; i <= pl->table_mask; i++) {
+        if (pl->table[i].used && (nearest < 0 || pl->table[i].deadline < nearest)) {
+            nearest = pl->table[i].deadline;
+        }
+    }
+    if (nearest < 0) return -1;
+    if (nearest <= now) return 0;
+    return (int)((nearest - now) * 1000.0) + 1;
+}
+
+int pipeline_done(const pipeline_t *pl)
+{
+    return pl->completed == pl->count;
+}
+
+// pipeline_run() on a ring: each round is one io_uring_enter() submitting the sends and waiting
+static int pipeline_run_ring(pipeline_t *pl)
+{
+    while (!pipeline_done(pl)) {
+        if (pipeline_fill(pl) < 0) return -1;
+
+        size_t before = pl->ring->syscalls;
+        int waited = uring_wait(pl->ring, pipeline_next_timeout(pl, time_now()));
+        pl->syscalls += pl->ring->syscalls - before;
+        if (waited < 0 && errno != EINTR && errno != ETIME) {
+            perror("io_uring_enter failed");
+            return -1;
+        }
+        if (pipeline_reap(pl->ring) < 0) return -1;
+
+        pipeline_expire(pl, time_now());
+    }
+    return 0;
+}
+
+/*
+ * @brief Runs the pipeline until every command got its result or timed out.
+ * @retval 0 on success, -1 on a socket error.
+ */
+int pipeline_run(pipeline_t *pl)
+{
+    struct pollfd pfd = {.fd = pl->sockfd, .events = POLLIN};
+
+    if (pl->ring != NULL) return pipeline_run_ring(pl);
+
+    while (!pipeline_done(pl)) {
+        if (pipeline_fill(pl) < 0) return -1;
+
+        pl->syscalls++;
+        int ready = poll(&pfd, 1, pipeline_next_timeout(pl, time_now()));
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll failed");
+            return -1;
+        }
+        if (ready > 0 && pipeline_drain(pl) < 0) return -1;
+
+        pipeline_expire(pl, time_now());
+    }
+    return 0;
+}
+
+/*
+ * @brief Parses "a.b.c.d" or "a.b.c.d:port" (the port defaults to CLIENT_PORT).
+ * @retval 0 on success, -1 on an invalid address.
+ */
+int parse_address(const char *text, struct sockaddr_in *addr)
+{
+    char host[64];
+    const char *colon = strchr(text, ':');
+    long port = CLIENT_PORT;
+    size_t len = colon ? (size_t)(colon - text) : strlen(text);
+
+    if (len == 0 || len >= sizeof(host)) return -1;
+    memcpy(host, text, len);
+    host[len] = '\0';
+
+    if (colon) {
+        char *end;
+        port = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || port < 1 || port > 65535) return -1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr->sin_addr) != 1) return -1;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "result_agg.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+/*
+ * Coalesces the results of batched commands into RESULT_BATCH_TAG frames: one datagram (and one
+ * pass through lwIP) for up to RESULT_BATCH_MAX results instead of one each.
+ * Results of one controller are collected until the frame is full, the oldest one waited
+ * RESULT_AGG_TIMEOUT_MS, or the caller has nothing else queued. The age is checked when a result
+ * is added and at every iteration boundary of the test that runs meanwhile, so a result waits
+ * at most RESULT_AGG_TIMEOUT_MS plus one iteration.
+ *
+ * Only the perform_tests task uses it, so there is no locking.
+ */
+
+#pragma pack(1)  // Disable padding
+typedef struct result_frame_t {
+	batch_header_t header;
+	result_pro_t results[RESULT_BATCH_MAX];
+} result_frame_t;
+#pragma pack()  // Restore default packing
+
+static result_frame_t frame;
+static ip_addr_t frame_addr;
+static u16_t frame_port;
+static TickType_t first_tick;		// When the oldest buffered result was added
+static result_send_fn send_frame = NULL;
+
+void result_agg_init(result_send_fn send){
+	send_frame = send;
+	frame.header.tag = RESULT_BATCH_TAG;
+	frame.header.count = 0;
+}
+
+/*
+ * @brief Sends the buffered results: a single one as a plain result_pro_t, more as a batch frame.
+ */
+void result_agg_flush(void){
+	if (frame.header.count == 0 || send_frame == NULL) return;
+
+	if (frame.header.count == 1) {
+		send_frame(&frame.results[0], sizeof(result_pro_t), &frame_addr, frame_port);
+	}
+	else {
+		send_frame(&frame, BATCH_HEADER_SIZE + frame.header.count * sizeof(result_pro_t), &frame_addr, frame_port);
+	}
+	frame.header.count = 0;
+}
+
+/*
+ * @brief Buffers a result for the controller at addr:port. Results for another controller
+ * flush the buffer first, a full buffer is sent at once.
+ */
+void result_agg_add(result_pro_t result, const ip_addr_t *addr, u16_t port){
+	if (frame.header.count > 0 && (!ip_addr_cmp(&frame_addr, addr) || frame_port != port)) {
+		result_agg_flush();
+	}
+	if (frame.header.count == 0) {
+		ip_addr_copy(frame_addr, *addr);
+		frame_port = port;
+		first_tick = xTaskGetTickCount();
+	}
+
+	frame.results[frame.header.count++] = result;
+	if (frame.header.count == RESULT_BATCH_MAX) result_agg_flush();
+}
+
+/*
+ * @retval 1 if the oldest buffered result waited RESULT_AGG_TIMEOUT_MS, 0 otherwise.
+ */
+uint8_t result_agg_due(void){
+	if (frame.header.count == 0) return 0;
+	return (xTaskGetTickCount() - first_tick) >= pdMS_TO_TICKS(RESULT_AGG_TIMEOUT_MS);
+}
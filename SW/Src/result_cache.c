@@ -0,0 +1,60 @@
+#include "result_cache.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+/*
+ * Recently seen test IDs and their results, per controller: several controllers may share
+ * the UUT, each numbering its tests from its own ID file.
+ * A command resent by the client (its result was lost, or it was slow) is answered from
+ * here instead of running the test again.
+ *
+ * Written by the lwIP thread (udp_receive_callback) and the perform_tests task, so every
+ * access is a short critical section around cache_table.c.
+ */
+
+static cache_table_t cache;
+
+// The sender's IPv4 address as the cache table keeps it
+#define SENDER(addr)	ip4_addr_get_u32(ip_2_ip4(addr))
+
+/*
+ * @brief Looks up a received test_id.
+ * @param test_id: The ID of the received command.
+ * @param addr, port: Its sender, a test_id of another controller is another command.
+ * @param result: Set to the cached result when the test already completed.
+ * @retval CacheState: What to do with the command.
+ */
+CacheState result_cache_check(uint32_t test_id, const ip_addr_t *addr, u16_t port, result_pro_t *result){
+	taskENTER_CRITICAL();
+	CacheState state = cache_table_check(&cache, test_id, SENDER(addr), port, result);
+	taskEXIT_CRITICAL();
+	return state;
+}
+
+/*
+ * @brief Marks a test_id as accepted. Must be called before the command is queued,
+ * so that a resend arriving while it runs is not queued again.
+ */
+void result_cache_pending(uint32_t test_id, const ip_addr_t *addr, u16_t port){
+	taskENTER_CRITICAL();
+	cache_table_pending(&cache, test_id, SENDER(addr), port);
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * @brief Stores the result of a completed test for later resends of its command.
+ */
+void result_cache_complete(result_pro_t result, const ip_addr_t *addr, u16_t port){
+	taskENTER_CRITICAL();
+	cache_table_complete(&cache, result, SENDER(addr), port);
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * @brief Drops a pending test_id whose command could not be queued, so a resend runs it.
+ */
+void result_cache_forget(uint32_t test_id, const ip_addr_t *addr, u16_t port){
+	taskENTER_CRITICAL();
+	cache_table_forget(&cache, test_id, SENDER(addr), port);
+	taskEXIT_CRITICAL();
+}
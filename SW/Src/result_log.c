@@ -0,0 +1,243 @@
+/**
+  * @brief Binary append-only result log
+  *
+  * testing_log.bin is a small header followed by fixed size result_record_t records.
+  * The writer collects RESULT_LOG_BATCH records and appends them with a single write(),
+  * the reader maps the whole file and walks the records in place.
+  */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "result_log.h"
+
+static int write_all(int fd, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        bytes += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int header_valid(const result_log_header_t *header)
+{
+    return header->magic == RESULT_LOG_MAGIC && header->version == RESULT_LOG_VERSION &&
+           header->record_size == sizeof(result_record_t);
+}
+
+/*
+ * @brief Opens (or creates) a binary log for appending.
+ * @retval 0 on success, -1 on failure or if the file is not a result log.
+ */
+int result_log_open(result_log_t *log, const char *path)
+{
+    struct stat st;
+    result_log_header_t header;
+
+    log->used = 0;
+    log->fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (log->fd < 0) {
+        perror("Error: Could not open the binary log");
+        return -1;
+    }
+
+    // The first client to create the file writes its header
+    if (flock(log->fd, LOCK_EX) < 0 || fstat(log->fd, &st) < 0) {
+        perror("Error: Could not lock the binary log");
+        close(log->fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        header.magic = RESULT_LOG_MAGIC;
+        header.version = RESULT_LOG_VERSION;
+        header.record_size = sizeof(result_record_t);
+        if (write_all(log->fd, &header, sizeof(header)) < 0) {
+            perror("Error: Could not write the binary log header");
+            close(log->fd);
+            return -1;
+        }
+    }
+    else if (pread(log->fd, &header, sizeof(header), 0) != sizeof(header) || !header_valid(&header)) {
+        printf("Error: %s is not a result log of this version\n", path);
+        close(log->fd);
+        return -1;
+    }
+    flock(log->fd, LOCK_UN);
+    return 0;
+}
+
+/*
+ * @brief Buffers the record of one outcome, writing the buffer out when it is full.
+ * @retval 0 on success, -1 on a write error.
+ */
+int result_log_append(result_log_t *log, const test_outcome_t *outcome)
+{
+    result_record_t *record = &log->buffer[log->used++];
+
+    record->test_id = outcome->result.test_id;
+    record->sent_us = (int64_t)outcome->sent.tv_sec * 1000000 + outcome->sent.tv_usec;
+    record->duration_us = (uint32_t)(outcome->duration * 1000000.0);
+    record->result = outcome->result.test_result;
+    record->peripheral = outcome->command->peripheral & PERIPHERAL_MASK;
+    record->pattern_length = outcome->command->bit_pattern_length;
+    record->flags = outcome->timed_out ? RECORD_TIMED_OUT : 0;
+    record->reserved = 0;
+
+    if (log->used == RESULT_LOG_BATCH) return result_log_flush(log);
+    return 0;
+}
+
+int result_log_flush(result_log_t *log)
+{
+    if (log->used == 0) return 0;
+
+    // O_APPEND keeps batches of parallel clients from overwriting each other
+    int status = write_all(log->fd, log->buffer, log->used * sizeof(result_record_t));
+    if (status < 0) perror("Error: Could not write to the binary log");
+    log->used = 0;
+    return status;
+}
+
+int result_log_close(result_log_t *log)
+{
+    int status = result_log_flush(log);
+    close(log->fd);
+    log->fd = -1;
+    return status;
+}
+
+/*
+ * @brief Maps a whole binary log read-only. A partly written last record is ignored.
+ * @retval 0 on success, -1 on failure or if the file is not a result log.
+ */
+int result_log_map(result_log_map_t *view, const char *path)
+{
+    struct stat st;
+
+    memset(view, 0, sizeof(*view));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error: Could not open the binary log");
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(result_log_header_t)) {
+        printf("Error: %s is not a result log\n", path);
+        close(fd);
+        return -1;
+    }
+
+    view->length = st.st_size;
+    view->map = mmap(NULL, view->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view->map == MAP_FAILED) {
+        perror("Error: Could not map the binary log");
+        view->map = NULL;
+        return -1;
+    }
+    if (!header_valid(view->map)) {
+        printf("Error: %s is not a result log of this version\n", path);
+        result_log_unmap(view);
+        return -1;
+    }
+
+    // The records are read front to back exactly once
+    madvise(view->map, view->length, MADV_SEQUENTIAL);
+    view->records = (const result_record_t *)((const uint8_t *)view->map + sizeof(result_log_header_t));
+    view->count = (view->length - sizeof(result_log_header_t)) / sizeof(result_record_t);
+    return 0;
+}
+
+void result_log_unmap(result_log_map_t *view)
+{
+    if (view->map) munmap(view->map, view->length);
+    memset(view, 0, sizeof(*view));
+}
+
+const char *result_name(int32_t result)
+{
+    switch (result) {
+    case TEST_ERR:  return "TEST_ERR";
+    case TEST_PASS: return "TEST_PASS";
+    case TEST_FAIL: return "TEST_FAIL";
+    default:        return "UNKNOWN";
+    }
+}
+
+// The peripherals by slot, with their command line names
+static const struct { Peripheral bit; const char *name; } peripherals[PERIPHERAL_COUNT] = {
+    {TIMER, "TIMER"}, {UART, "UART"}, {SPI, "SPI"}, {I2C, "I2C"}, {ADC_P, "ADC"},
+};
+
+/*
+ * @brief Index 0..PERIPHERAL_COUNT-1 of a single peripheral bit (option flags ignored), -1 for anything else.
+ */
+int peripheral_slot(Peripheral peripheral)
+{
+    for (int slot = 0; slot < PERIPHERAL_COUNT; slot++) {
+        if ((peripheral & PERIPHERAL_MASK) == peripherals[slot].bit) return slot;
+    }
+    return -1;
+}
+
+// The peripheral bit of a slot, 0 for an invalid slot
+Peripheral peripheral_at(int slot)
+{
+    return (slot < 0 || slot >= PERIPHERAL_COUNT) ? 0 : peripherals[slot].bit;
+}
+
+const char *peripheral_name(Peripheral peripheral)
+{
+    int slot = peripheral_slot(peripheral);
+    return slot < 0 ? "UNKNOWN" : peripherals[slot].name;
+}
+
+/*
+ * @brief The peripheral bit of a command line name (TIMER/UART/SPI/I2C/ADC), 0 if unknown.
+ */
+Peripheral peripheral_by_name(const char *name)
+{
+    for (int slot = 0; slot < PERIPHERAL_COUNT; slot++) {
+        if (strcmp(name, peripherals[slot].name) == 0) return peripherals[slot].bit;
+    }
+    return 0;
+}
+
+void result_log_print_header(FILE *out)
+{
+    fprintf(out, LOG_HEADER_FORMAT, "Test ID", "Sent At", "Result", "Duration (s)");
+}
+
+/*
+ * @brief Prints a record as a testing_log.txt line.
+ */
+void result_log_print_record(FILE *out, const result_record_t *record)
+{
+    // Records arrive in time order, so the formatted time rarely changes between lines
+    static time_t last_sec = -1;
+    static char time_str[100];
+    time_t sec = (time_t)(record->sent_us / 1000000);
+
+    if (sec != last_sec) {
+        struct tm tm_info;
+        localtime_r(&sec, &tm_info);
+        strftime(time_str, sizeof(time_str), LOG_TIME_FORMAT, &tm_info);
+        last_sec = sec;
+    }
+    fprintf(out, LOG_LINE_FORMAT, record->test_id, time_str, result_name(record->result),
+            record->duration_us / 1000000.0);
+}
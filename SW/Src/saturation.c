@@ -0,0 +1,158 @@
+/**
+  * @brief Intake saturation benchmark
+  *
+  * Offers commands at a fixed rate (open loop, independent of how fast results come back)
+  * for a while, then at a higher rate, and so on. Every step records how many commands the
+  * UUT accepted, rejected (test queue full: TEST_ERR under the command's ID) or answered late
+  * (no result within the timeout), and the latency of the accepted ones. The knee is the
+  * highest rate the UUT still keeps up with.
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "saturation.h"
+#include "id_alloc.h"
+#include "latency_hist.h"
+
+// Outcomes of one offered rate
+typedef struct saturation_step_t {
+    double offered;                 // Commands per second
+    size_t sent;
+    size_t accepted;                // TEST_PASS or TEST_FAIL
+    size_t rejected;                // TEST_ERR
+    size_t late;                    // No result within the timeout
+    double elapsed;
+    latency_hist_t latency;
+} saturation_step_t;
+
+/*
+ * @brief Parses START:STEP:MAX[:SECONDS] (commands per second, seconds per step).
+ * @retval 0 on success, -1 on a bad ramp.
+ */
+int saturation_parse(const char *text, saturation_config_t *sat)
+{
+    memset(sat, 0, sizeof(*sat));
+    sat->step_seconds = SATURATION_DEFAULT_SECONDS;
+
+    int fields = sscanf(text, "%lf:%lf:%lf:%lf", &sat->start_rate, &sat->step_rate, &sat->max_rate,
+                        &sat->step_seconds);
+    if (fields < 3 || sat->start_rate <= 0 || sat->step_rate <= 0 || sat->max_rate < sat->start_rate ||
+        sat->step_seconds <= 0) {
+        return -1;
+    }
+    if ((sat->max_rate - sat->start_rate) / sat->step_rate + 1 > SATURATION_MAX_STEPS) {
+        printf("At most %d steps\n", SATURATION_MAX_STEPS);
+        return -1;
+    }
+    return 0;
+}
+
+static void step_outcome(const test_outcome_t *outcome, void *ctx)
+{
+    saturation_step_t *step = ctx;
+
+    if (outcome->timed_out) step->late++;
+    else if (outcome->result.test_result == TEST_ERR) step->rejected++;
+    else {
+        step->accepted++;
+        hist_record(&step->latency, (uint64_t)(outcome->duration * 1e9));
+    }
+}
+
+// A step the UUT kept up with: hardly anything turned away, and close to the offered rate achieved
+static int step_sustained(const saturation_step_t *step)
+{
+    if (step->sent == 0) return 0;
+    double lost = 100.0 * (step->rejected + step->late) / step->sent;
+    double achieved = step->elapsed > 0 ? step->accepted / step->elapsed : 0;
+    return lost <= SATURATION_LOSS_LIMIT && achieved >= step->offered * SATURATION_RATE_LIMIT / 100.0;
+}
+
+static int run_step(int sockfd, const struct sockaddr_in *uut, const test_command_t *templates, size_t template_count,
+                    test_command_t *commands, size_t count, const pipeline_config_t *cfg, saturation_step_t *step)
+{
+    pipeline_t pipeline;
+    pipeline_config_t step_config = *cfg;
+
+    // Open loop: no window limit worth mentioning and no resends hiding the rejections
+    step_config.window = PIPELINE_MAX_WINDOW;
+    step_config.retries = 0;
+    step_config.rate = step->offered;
+
+    uint32_t first_id = id_alloc_reserve(count);
+    if (first_id == 0) return -1;
+    for (size_t i = 0; i < count; i++) {
+        commands[i] = templates[i % template_count];
+        commands[i].test_id = first_id + i;
+    }
+
+    if (pipeline_init(&pipeline, sockfd, uut, commands, count, &step_config, step_outcome, step) < 0) return -1;
+    double started = time_now();
+    int status = pipeline_run(&pipeline);
+    step->elapsed = time_now() - started;
+    step->sent = pipeline.next;
+    pipeline_free(&pipeline);
+    return status;
+}
+
+/*
+ * @brief Ramps the offered rate and prints a line per step and the knee point.
+ * Stops early after two steps in a row the UUT could not keep up with.
+ * @param templates: The commands to offer, in turn.
+ * @retval 0 on success, -1 on a socket or ID allocation error.
+ */
+int saturation_run(int sockfd, const struct sockaddr_in *uut, const test_command_t *templates, size_t template_count,
+                   const saturation_config_t *sat, const pipeline_config_t *cfg)
+{
+    saturation_step_t *steps = calloc(SATURATION_MAX_STEPS, sizeof(saturation_step_t));
+    test_command_t *commands = malloc((size_t)(sat->max_rate * sat->step_seconds + 1) * sizeof(test_command_t));
+    double knee = 0;
+    int past_knee = 0, in_row = 0, status = 0, count = 0;
+
+    if (steps == NULL || commands == NULL) {
+        perror("Error: Could not allocate the benchmark");
+        free(steps);
+        free(commands);
+        return -1;
+    }
+
+    printf("%10s %8s %9s %9s %9s %11s %9s %9s\n", "Offered/s", "Sent", "Accepted", "Rejected", "Late",
+           "Achieved/s", "p50 (ms)", "p99 (ms)");
+    for (double rate = sat->start_rate; rate <= sat->max_rate + 1e-9 && in_row < 2; rate += sat->step_rate) {
+        saturation_step_t *step = &steps[count++];
+        size_t step_count = (size_t)(rate * sat->step_seconds + 0.5);
+        if (step_count == 0) step_count = 1;
+
+        hist_init(&step->latency);
+        step->offered = rate;
+        if (run_step(sockfd, uut, templates, template_count, commands, step_count, cfg, step) < 0) {
+            status = -1;
+            break;
+        }
+
+        printf("%10.1f %8zu %9zu %9zu %9zu %11.1f %9.3f %9.3f\n", step->offered, step->sent, step->accepted,
+               step->rejected, step->late, step->elapsed > 0 ? step->accepted / step->elapsed : 0.0,
+               hist_percentile(&step->latency, 50.0) / 1e6, hist_percentile(&step->latency, 99.0) / 1e6);
+
+        if (step_sustained(step)) {
+            if (!past_knee) knee = rate;
+            in_row = 0;
+        }
+        else {
+            past_knee = 1;
+            in_row++;
+        }
+    }
+
+    if (status == 0) {
+        if (knee == 0) printf("Knee: below %.1f commands/sec\n", sat->start_rate);
+        else if (!past_knee) printf("Knee: above %.1f commands/sec (not reached)\n", knee);
+        else printf("Knee: ~%.1f commands/sec (last rate with <= %.0f%% rejected or late and >= %.0f%% achieved)\n",
+                    knee, SATURATION_LOSS_LIMIT, SATURATION_RATE_LIMIT);
+    }
+
+    free(steps);
+    free(commands);
+    return status;
+}
@@ -37,8 +37,10 @@ Result spi_testing(test_command_t* command){
 
 	for(uint8_t i = 0; i < command->iterations; i++)
 	{
+	    if (test_monitor_checkpoint()) return TEST_ERR;
 	    printf("SPI_TEST: Iteration %u/%u -\n\r", i + 1, command->iterations);
 	    memset(rx_buffer, 0, command->bit_pattern_length);
+	    test_monitor_iteration_start();
 
 	    reset_test();
 	    clear_flags(SPI_SENDER);
@@ -63,12 +65,14 @@ Result spi_testing(test_command_t* command){
 	    // 3. Wait for the Master's Transmit to complete
 	    if (xSemaphoreTake(SpiTxHandle, TIMEOUT) != pdPASS) {
 	         printf("Master TX timeout\n\r");
+		     test_monitor_timeout();
 		     reset_test();
 		     return TEST_FAIL;
 	    }
 	    // 4. Wait for the Slave's Receive to complete, which triggers its echo back
 	    if (xSemaphoreTake(SpiSlaveRxHandle, TIMEOUT) != pdPASS) {
 	         printf("Slave RX timeout\n\r");
+		     test_monitor_timeout();
 		     reset_test();
 	         return TEST_FAIL;
 	    }
@@ -98,6 +102,7 @@ Result spi_testing(test_command_t* command){
 	    // 6. Wait for Master's final Receive to complete
 	    if (xSemaphoreTake(SpiRxHandle, TIMEOUT) != pdPASS) {
 	         printf("Master RX timeout\n\r");
+	         test_monitor_timeout();
 	         reset_test();
 	         return TEST_FAIL;
 	    }
@@ -111,6 +116,7 @@ Result spi_testing(test_command_t* command){
 	        uint32_t sent_crc = calculate_crc(tx_buffer, command->bit_pattern_length);
 	        uint32_t received_crc = calculate_crc(rx_buffer, command->bit_pattern_length);
 	        if (sent_crc != received_crc) {
+	            test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 	            printf("SPI_TEST: CRC mismatch on iteration %u.\n", i + 1);
 	            return TEST_FAIL;
 	        }
@@ -119,6 +125,7 @@ Result spi_testing(test_command_t* command){
 	    {
 	        int comp = memcmp(tx_buffer, rx_buffer, command->bit_pattern_length);
 	        if (comp != 0) {
+	            test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 	            printf("Data mismatch on iteration %u.\n", i + 1);
 				printf("Sent: %.*s\n", command->bit_pattern_length, tx_buffer);
 				printf("Recv: %.*s\n", command->bit_pattern_length, rx_buffer);
@@ -126,8 +133,9 @@ Result spi_testing(test_command_t* command){
 	        }
 	    }
 	    printf("Data Match on iteration %u.\n", i + 1);
+	    test_monitor_iteration(i);
 
-        osDelay(10);
+        test_monitor_pace();
 	}
 
     return TEST_PASS;
@@ -0,0 +1,254 @@
+#include "test_monitor.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cmsis_os.h"
+#include "stm32f7xx.h"
+/*
+ * Watches the running test: perform_tests() brackets it with test_monitor_begin()/_end() and the
+ * peripheral tests report every finished iteration. Iterations are timed with the DWT cycle
+ * counter; for a STREAM_PROGRESS command the records are sent to its controller in PROGRESS_TAG
+ * frames, at most PROGRESS_INTERVAL_MS apart, so a long test can be followed while it runs.
+ *
+ * The tests also say why they failed (timeout, mismatching byte), which together with the
+ * transfer times of the passed iterations makes up the result_ext_t of an EXTENDED_RESULT command.
+ * Before every iteration the test calls test_monitor_checkpoint(): a cancelled test ends there
+ * with TEST_ERR, and the checkpoint hook of perform_tests() may run a more urgent command in the
+ * meantime, the watch of the preempted test kept aside until it resumes.
+ *
+ * Only the perform_tests task uses it, so there is no locking.
+ */
+
+#pragma pack(1)  // Disable padding
+typedef struct progress_frame_t {
+	progress_header_t header;
+	progress_record_t records[PROGRESS_RECORDS_MAX];
+} progress_frame_t;
+#pragma pack()  // Restore default packing
+
+// What is watched of one test, kept aside while another test preempts it
+typedef struct test_watch_t {
+	progress_frame_t frame;
+	ip_addr_t frame_addr;
+	u16_t frame_port;
+	uint8_t streaming;				// 1 - the test streams its progress
+	uint8_t iterations_done;
+	TickType_t last_sent;
+	uint32_t last_cycles;
+	uint64_t elapsed_cycles;		// Since test_monitor_begin(), wraps of CYCCNT included
+	uint32_t transfer_started;		// CYCCNT at test_monitor_iteration_start()
+	uint32_t transfer_min;			// Transfer times of the passed iterations (cycles)
+	uint32_t transfer_max;
+	uint64_t transfer_sum;
+	uint8_t failure;				// FAILURE_* reported by the test
+	uint16_t mismatch_offset;
+	uint8_t expected_byte;
+	uint8_t actual_byte;
+	const cmd_desc_t *running;		// Descriptor of the test, its `cancelled` set by the lwIP thread
+} test_watch_t;
+
+static test_watch_t watch;
+static result_send_fn send_frame = NULL;
+static checkpoint_fn checkpoint_hook = NULL;
+
+/*
+ * @brief Sets up the monitor.
+ * @param send: Sends the progress frames.
+ * @param checkpoint: Called at the iteration boundaries of the running test with its descriptor,
+ *                    NULL - tests are never preempted.
+ */
+void test_monitor_init(result_send_fn send, checkpoint_fn checkpoint){
+	send_frame = send;
+	checkpoint_hook = checkpoint;
+	watch.frame.header.batch.tag = PROGRESS_TAG;
+
+	// Start the cycle counter
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;		// Unlock the DWT registers (Cortex-M7)
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static void progress_flush(void){
+	if (watch.frame.header.batch.count == 0 || send_frame == NULL) return;
+
+	send_frame(&watch.frame, sizeof(progress_header_t) + watch.frame.header.batch.count * sizeof(progress_record_t),
+			&watch.frame_addr, watch.frame_port);
+	watch.frame.header.batch.count = 0;
+	watch.last_sent = xTaskGetTickCount();
+}
+
+static void progress_add(uint8_t iteration, uint8_t status){
+	progress_record_t *record = &watch.frame.records[watch.frame.header.batch.count++];
+	record->iteration = iteration;
+	record->status = status;
+	record->elapsed_us = test_monitor_elapsed_us();
+
+	if (watch.frame.header.batch.count == PROGRESS_RECORDS_MAX ||
+		(xTaskGetTickCount() - watch.last_sent) >= pdMS_TO_TICKS(PROGRESS_INTERVAL_MS)) {
+		progress_flush();
+	}
+}
+
+/*
+ * @brief Microseconds since the running test started. The counter wraps every 2^32 cycles
+ * (about 20 s at 216 MHz), so it must be read at least that often - once per iteration is.
+ */
+uint32_t test_monitor_elapsed_us(void){
+	uint32_t now = DWT->CYCCNT;
+	watch.elapsed_cycles += (uint32_t)(now - watch.last_cycles);
+	watch.last_cycles = now;
+	return (uint32_t)(watch.elapsed_cycles / (SystemCoreClock / 1000000u));
+}
+
+/*
+ * @brief Starts watching a test. Progress is streamed to its controller if the command asks for it.
+ */
+void test_monitor_begin(const cmd_desc_t *desc){
+	const test_command_t *cmd = desc->cmd;
+
+	watch.running = desc;
+	watch.last_cycles = DWT->CYCCNT;
+	watch.elapsed_cycles = 0;
+	watch.iterations_done = 0;
+	watch.transfer_started = watch.last_cycles;
+	watch.transfer_min = UINT32_MAX;
+	watch.transfer_max = 0;
+	watch.transfer_sum = 0;
+	watch.failure = FAILURE_NONE;
+	watch.streaming = (cmd->peripheral & STREAM_PROGRESS) != 0;
+	if (!watch.streaming) return;
+
+	ip_addr_copy(watch.frame_addr, desc->reply_addr);
+	watch.frame_port = desc->reply_port;
+	watch.frame.header.test_id = cmd->test_id;
+	watch.frame.header.iterations = cmd->iterations;
+	watch.frame.header.batch.count = 0;
+	watch.last_sent = xTaskGetTickCount();
+}
+
+/*
+ * @brief Called by a peripheral test as an iteration starts its transfer.
+ */
+void test_monitor_iteration_start(void){
+	watch.transfer_started = DWT->CYCCNT;
+}
+
+/*
+ * @brief Called by a peripheral test after each iteration that passed.
+ * @param iteration: Its index, from 0.
+ */
+void test_monitor_iteration(uint8_t iteration){
+	uint32_t cycles = DWT->CYCCNT - watch.transfer_started;
+	if (cycles < watch.transfer_min) watch.transfer_min = cycles;
+	if (cycles > watch.transfer_max) watch.transfer_max = cycles;
+	watch.transfer_sum += cycles;
+
+	watch.iterations_done = iteration + 1;
+	if (watch.streaming) progress_add(iteration, PROGRESS_PASSED);
+}
+
+/*
+ * @brief Called by a peripheral test before every iteration. Commands that may preempt the test
+ * run from here, one level deep: a preempting test does not get preempted in turn.
+ * @retval 1 if the running test was cancelled: the test returns TEST_ERR at once.
+ */
+uint8_t test_monitor_checkpoint(void){
+	static test_watch_t preempted;
+	static uint8_t preempting = 0;
+
+	if (watch.running == NULL) return 0;
+	if (checkpoint_hook != NULL && !preempting) {
+		test_monitor_elapsed_us();		// Bring elapsed_cycles up to date before setting it aside
+		preempted = watch;
+		preempting = 1;
+		TickType_t paused_at = xTaskGetTickCount();
+		checkpoint_hook(preempted.running);
+		TickType_t paused = xTaskGetTickCount() - paused_at;
+		preempting = 0;
+		watch = preempted;
+		// The cycle counter may have wrapped meanwhile, the tick count did not
+		watch.elapsed_cycles += (uint64_t)paused * (SystemCoreClock / configTICK_RATE_HZ);
+		watch.last_cycles = DWT->CYCCNT;
+	}
+	return watch.running->cancelled;
+}
+
+/*
+ * @brief Called by a peripheral test after every passed iteration: a small delay so the
+ * iterations do not overwhelm the UUT, except in a soak, which runs them back to back.
+ */
+void test_monitor_pace(void){
+	const cmd_desc_t *desc = watch.running;
+	if (desc != NULL && (desc->soak_iterations > 0 || desc->soak_ms > 0)) return;
+	osDelay(10);
+}
+
+// Iterations the running test passed so far
+uint8_t test_monitor_iterations(void){
+	return watch.iterations_done;
+}
+
+// A transfer did not complete in time
+void test_monitor_timeout(void){
+	watch.failure = FAILURE_TIMEOUT;
+}
+
+/*
+ * @brief The data came back different: records the first byte that differs.
+ */
+void test_monitor_mismatch(const uint8_t *expected, const uint8_t *actual, uint16_t length){
+	uint16_t offset = 0;
+	while (offset < length - 1 && expected[offset] == actual[offset]) offset++;
+	test_monitor_value(offset, expected[offset], actual[offset]);
+}
+
+// A single value came back different, e.g. an ADC reading out of tolerance
+void test_monitor_value(uint16_t offset, uint8_t expected, uint8_t actual){
+	watch.failure = FAILURE_DATA;
+	watch.mismatch_offset = offset;
+	watch.expected_byte = expected;
+	watch.actual_byte = actual;
+}
+
+/*
+ * @brief Ends the test: a failure is recorded against the iteration it stopped in, and what is
+ * left is sent ahead of the result.
+ */
+void test_monitor_end(Result result){
+	// Failures the test did not explain came from its HAL calls
+	if (result == TEST_FAIL && watch.failure == FAILURE_NONE) watch.failure = FAILURE_PERIPHERAL;
+	else if (result == TEST_ERR) watch.failure = (watch.running != NULL && watch.running->cancelled) ? FAILURE_CANCELLED : FAILURE_INVALID;
+	watch.running = NULL;
+	if (!watch.streaming) return;
+
+	if (result != TEST_PASS) progress_add(watch.iterations_done, PROGRESS_FAILED);
+	progress_flush();
+	watch.streaming = 0;
+}
+
+/*
+ * @brief Fills the extended result of the test that just ended.
+ * @param ext: The record to send.
+ * @param result: The plain result of the test.
+ */
+void test_monitor_result(result_ext_t *ext, result_pro_t result){
+	uint32_t cycles_per_us = SystemCoreClock / 1000000u;
+
+	memset(ext, 0, sizeof(*ext));
+	ext->tag = RESULT_EXT_TAG;
+	ext->test_id = result.test_id;
+	ext->test_result = result.test_result;
+	ext->failure = watch.failure;
+	ext->iterations_passed = watch.iterations_done;
+	if (watch.failure == FAILURE_DATA) {
+		ext->mismatch_offset = watch.mismatch_offset;
+		ext->expected = watch.expected_byte;
+		ext->actual = watch.actual_byte;
+	}
+	if (watch.iterations_done > 0) {
+		ext->min_us = watch.transfer_min / cycles_per_us;
+		ext->avg_us = (uint32_t)(watch.transfer_sum / watch.iterations_done / cycles_per_us);
+		ext->max_us = watch.transfer_max / cycles_per_us;
+	}
+}
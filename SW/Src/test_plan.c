@@ -0,0 +1,233 @@
+/**
+  * @brief Test plans: many tests described in one file, run over a single socket
+  *
+  * The plan is parsed into ready to send commands once. The client repeats them as often
+  * as asked and feeds every outcome back here, so the summary reports each plan line.
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "test_plan.h"
+#include "result_log.h"
+
+// Splits the next white space separated token off *text, honouring "double quotes"
+static char *next_token(char **text)
+{
+    char *start = *text, *end;
+
+    while (isspace((unsigned char)*start)) start++;
+    if (*start == '\0') return NULL;
+
+    if (*start == '"') {
+        start++;
+        end = strchr(start, '"');
+        if (end == NULL) return NULL;
+    }
+    else {
+        end = start;
+        while (*end != '\0' && !isspace((unsigned char)*end)) end++;
+    }
+    *text = (*end != '\0') ? end + 1 : end;
+    *end = '\0';
+    return start;
+}
+
+/*
+ * @brief Fills the command's pattern from a @generator spec.
+ * @retval 0 on success, -1 on an unknown generator or bad length.
+ */
+static int generate_pattern(test_command_t *command, const char *spec)
+{
+    char name[16];
+    unsigned length = 0;
+    int arg = 0;
+    int fields = sscanf(spec, "@%15[a-z]:%u:%i", name, &length, &arg);
+
+    if (fields < 2 || length < 1 || length > PLAN_MAX_PATTERN) return -1;
+
+    if (strcmp(name, "random") == 0) {
+        // Same plan, same bytes: a seed keeps failing patterns reproducible
+        unsigned state = fields == 3 ? (unsigned)arg : 1;
+        for (unsigned i = 0; i < length; i++) command->bit_pattern[i] = (uint8_t)(rand_r(&state) >> 7);
+    }
+    else if (strcmp(name, "counter") == 0) {
+        for (unsigned i = 0; i < length; i++) command->bit_pattern[i] = (uint8_t)i;
+    }
+    else if (strcmp(name, "fill") == 0 && fields == 3 && arg >= 0 && arg <= 0xff) {
+        memset(command->bit_pattern, arg, length);
+    }
+    else if (strcmp(name, "walk") == 0) {
+        for (unsigned i = 0; i < length; i++) command->bit_pattern[i] = (uint8_t)(1u << (i % 8));
+    }
+    else {
+        return -1;
+    }
+    command->bit_pattern_length = (uint8_t)length;
+    return 0;
+}
+
+// Same layout as the command line pattern: the string and its terminating '\0'
+static int string_pattern(test_command_t *command, const char *text)
+{
+    size_t len = strlen(text);
+
+    if (len + 1 > PLAN_MAX_PATTERN) return -1;
+    memcpy(command->bit_pattern, text, len + 1);
+    command->bit_pattern_length = (uint8_t)(len + 1);
+    return 0;
+}
+
+static int parse_line(plan_entry_t *entry, char *text)
+{
+    char *token;
+    const char *pattern = NULL;
+
+    memset(entry, 0, sizeof(*entry));
+
+    token = next_token(&text);
+    entry->command.peripheral = token ? peripheral_by_name(token) : 0;
+    if (entry->command.peripheral == 0) return -1;
+
+    token = next_token(&text);
+    long iterations = token ? strtol(token, NULL, 10) : 0;
+    if (iterations < 1 || iterations > 255) return -1;
+    entry->command.iterations = (uint8_t)iterations;
+
+    while ((token = next_token(&text)) != NULL) {
+        if (strncmp(token, "deadline=", 9) == 0) {
+            long deadline = strtol(token + 9, NULL, 10);
+            if (deadline < 1) return -1;
+            entry->deadline_ms = (unsigned)deadline;
+        }
+        else if (pattern == NULL) {
+            pattern = token;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    if (pattern == NULL) pattern = "This is the testing pattern!";
+    snprintf(entry->pattern_text, sizeof(entry->pattern_text), "%s", pattern);
+    if (pattern[0] == '@') return generate_pattern(&entry->command, pattern);
+    return string_pattern(&entry->command, pattern);
+}
+
+/*
+ * @brief Reads a plan file, '#' starts a comment.
+ * @retval 0 on success, -1 on a missing file, bad line or empty plan.
+ */
+int plan_load(test_plan_t *plan, const char *path)
+{
+    char line[512];
+    int line_num = 0;
+
+    memset(plan, 0, sizeof(*plan));
+
+    FILE *file_ptr = fopen(path, "r");
+    if (file_ptr == NULL) {
+        perror("Error: Could not open the test plan");
+        return -1;
+    }
+
+    plan->entries = calloc(PLAN_MAX_TESTS, sizeof(plan_entry_t));
+    if (plan->entries == NULL) {
+        perror("Error: Could not allocate the test plan");
+        fclose(file_ptr);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file_ptr) != NULL) {
+        line_num++;
+
+        // A '#' inside a quoted pattern is part of the pattern
+        int quoted = 0;
+        for (char *c = line; *c != '\0'; c++) {
+            if (*c == '"') quoted = !quoted;
+            else if (*c == '#' && !quoted) {
+                *c = '\0';
+                break;
+            }
+        }
+        char *text = line;
+        while (isspace((unsigned char)*text)) text++;
+        if (*text == '\0') continue;
+
+        if (plan->count == PLAN_MAX_TESTS) {
+            printf("Too many tests in %s (max %d)\n", path, PLAN_MAX_TESTS);
+            fclose(file_ptr);
+            return -1;
+        }
+        if (parse_line(&plan->entries[plan->count], text) < 0) {
+            printf("%s:%d: invalid test line\n", path, line_num);
+            fclose(file_ptr);
+            return -1;
+        }
+        plan->entries[plan->count].line = line_num;
+        plan->count++;
+    }
+    fclose(file_ptr);
+
+    if (plan->count == 0) {
+        printf("No tests in %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief Counts one outcome of a plan entry.
+ */
+void plan_record(test_plan_t *plan, size_t entry, const test_outcome_t *outcome)
+{
+    plan_entry_t *e = &plan->entries[entry];
+
+    if (outcome->timed_out) {
+        e->timeouts++;
+        return;
+    }
+    if (outcome->result.test_result == TEST_PASS) e->passed++;
+    else if (outcome->result.test_result == TEST_FAIL) e->failed++;
+    else e->errors++;
+
+    e->duration_sum += outcome->duration;
+    if (outcome->duration > e->duration_max) e->duration_max = outcome->duration;
+}
+
+/*
+ * @brief Prints a line per plan entry and the totals of the run.
+ */
+void plan_report(FILE *out, const test_plan_t *plan, double elapsed)
+{
+    size_t passed = 0, failed = 0, errors = 0, timeouts = 0;
+
+    fprintf(out, "%-5s %-6s %5s %-24s %7s %7s %7s %8s %10s %10s\n", "Line", "Periph", "Iter", "Pattern",
+            "Passed", "Failed", "Errors", "Timeouts", "Mean (ms)", "Max (ms)");
+    for (size_t i = 0; i < plan->count; i++) {
+        const plan_entry_t *e = &plan->entries[i];
+        size_t answered = e->passed + e->failed + e->errors;
+
+        fprintf(out, "%-5d %-6s %5u %-24.24s %7zu %7zu %7zu %8zu %10.3f %10.3f\n", e->line,
+                peripheral_name(e->command.peripheral), e->command.iterations, e->pattern_text,
+                e->passed, e->failed, e->errors, e->timeouts,
+                answered ? e->duration_sum / answered * 1000.0 : 0.0, e->duration_max * 1000.0);
+
+        passed += e->passed;
+        failed += e->failed;
+        errors += e->errors;
+        timeouts += e->timeouts;
+    }
+
+    size_t total = passed + failed + errors + timeouts;
+    fprintf(out, "Plan of %zu tests: %zu runs in %.3f s (%.1f tests/sec): %zu passed, %zu failed, %zu errors, %zu timed out\n",
+            plan->count, total, elapsed, elapsed > 0 ? total / elapsed : 0.0, passed, failed, errors, timeouts);
+}
+
+void plan_free(test_plan_t *plan)
+{
+    free(plan->entries);
+    plan->entries = NULL;
+    plan->count = 0;
+}
@@ -0,0 +1,182 @@
+#include "test_queue.h"
+
+#include <string.h>
+/*
+ * The commands waiting for perform_tests(), kept in a binary heap: the highest priority runs
+ * first, then the earliest deadline, then the earliest arrival - plain commands (all
+ * PRIORITY_DEFAULT, no deadline) keep their FIFO order.
+ *
+ * Pushed by the lwIP thread and popped by the perform_tests task, so the heap is only touched
+ * inside short critical sections. A push only wakes the consumer with a notification; the
+ * consumer pops until the heap is empty, so notifications that coalesce lose nothing.
+ */
+
+typedef struct queue_stats_t {
+	uint32_t queued;
+	uint32_t rejected;
+	uint32_t expired;
+	uint32_t preempted;
+	uint32_t started;			// Popped to run, for the average wait
+	uint64_t wait_ticks;
+	uint32_t wait_max_ticks;
+	uint8_t high_water;
+} queue_stats_t;
+
+static cmd_desc_t *heap[TEST_QUEUE_SIZE];
+static uint8_t count = 0;
+static uint32_t next_seq = 0;
+static TaskHandle_t consumer_task = NULL;
+static queue_stats_t stats;
+
+// 1 - a runs before b
+static uint8_t runs_before(const cmd_desc_t *a, const cmd_desc_t *b){
+	if (a->priority != b->priority) return a->priority > b->priority;
+	if (a->deadline != b->deadline) {
+		if (a->deadline == 0 || b->deadline == 0) return b->deadline == 0;	// No deadline goes last
+		return (int32_t)(a->deadline - b->deadline) < 0;
+	}
+	return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static void sift_up(uint8_t i){
+	while (i > 0) {
+		uint8_t parent = (i - 1) / 2;
+		if (!runs_before(heap[i], heap[parent])) break;
+		cmd_desc_t *tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void sift_down(uint8_t i){
+	for(;;) {
+		uint8_t first = i, left = 2 * i + 1, right = 2 * i + 2;
+		if (left < count && runs_before(heap[left], heap[first])) first = left;
+		if (right < count && runs_before(heap[right], heap[first])) first = right;
+		if (first == i) break;
+		cmd_desc_t *tmp = heap[i];
+		heap[i] = heap[first];
+		heap[first] = tmp;
+		i = first;
+	}
+}
+
+// Takes heap[i] out, the caller holds the critical section
+static cmd_desc_t* remove_at(uint8_t i){
+	cmd_desc_t *desc = heap[i];
+	heap[i] = heap[--count];
+	if (i < count) {
+		sift_down(i);
+		sift_up(i);
+	}
+	return desc;
+}
+
+// Takes out the top of the heap to run it, the caller holds the critical section
+static cmd_desc_t* start_top(void){
+	cmd_desc_t *desc = remove_at(0);
+	uint32_t waited = xTaskGetTickCount() - desc->queued_at;
+	stats.started++;
+	stats.wait_ticks += waited;
+	if (waited > stats.wait_max_ticks) stats.wait_max_ticks = waited;
+	return desc;
+}
+
+void test_queue_init(TaskHandle_t consumer){
+	taskENTER_CRITICAL();
+	count = 0;
+	consumer_task = consumer;
+	memset(&stats, 0, sizeof(stats));
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * @brief Queues a command for perform_tests(), its priority and deadline already set.
+ * @retval 1 on success, 0 when the queue is full (the caller rejects the command).
+ */
+uint8_t test_queue_push(cmd_desc_t *desc){
+	taskENTER_CRITICAL();
+	if (count == TEST_QUEUE_SIZE) {
+		stats.rejected++;
+		taskEXIT_CRITICAL();
+		return 0;
+	}
+	desc->queued_at = xTaskGetTickCount();
+	desc->seq = next_seq++;
+	heap[count] = desc;
+	sift_up(count++);
+	stats.queued++;
+	if (count > stats.high_water) stats.high_water = count;
+	taskEXIT_CRITICAL();
+
+	if (consumer_task != NULL) xTaskNotifyGive(consumer_task);
+	return 1;
+}
+
+/*
+ * @brief Takes the command to run next.
+ * @retval The descriptor, NULL when the queue is empty.
+ */
+cmd_desc_t* test_queue_pop(void){
+	cmd_desc_t *desc = NULL;
+	taskENTER_CRITICAL();
+	if (count > 0) desc = start_top();
+	taskEXIT_CRITICAL();
+	return desc;
+}
+
+/*
+ * @brief Takes the next command if it may preempt the running test at an iteration boundary:
+ * it has a higher priority and another peripheral (the running test's own peripheral may be
+ * set up between its iterations - a timer started, the DAC driven).
+ * @retval The descriptor, NULL when the running test goes on.
+ */
+cmd_desc_t* test_queue_pop_above(const cmd_desc_t *running){
+	cmd_desc_t *desc = NULL;
+	taskENTER_CRITICAL();
+	if (count > 0 && heap[0]->priority > running->priority &&
+		(heap[0]->cmd->peripheral & PERIPHERAL_MASK) != (running->cmd->peripheral & PERIPHERAL_MASK)) {
+		desc = start_top();
+		stats.preempted++;
+	}
+	taskEXIT_CRITICAL();
+	return desc;
+}
+
+/*
+ * @brief Takes a queued command whose deadline passed, to be answered without running.
+ * @retval The descriptor, NULL when no deadline passed.
+ */
+cmd_desc_t* test_queue_take_expired(void){
+	cmd_desc_t *desc = NULL;
+	TickType_t now = xTaskGetTickCount();
+
+	taskENTER_CRITICAL();
+	for(uint8_t i=0 ; i< count ; i++){
+		if (heap[i]->deadline != 0 && (int32_t)(now - heap[i]->deadline) > 0) {
+			desc = remove_at(i);
+			stats.expired++;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	return desc;
+}
+
+uint8_t test_queue_depth(void){
+	return count;
+}
+
+void test_queue_get_stats(tlv_queue_stats_t *out){
+	taskENTER_CRITICAL();
+	out->depth = count;
+	out->high_water = stats.high_water;
+	out->queued = stats.queued;
+	out->rejected = stats.rejected;
+	out->expired = stats.expired;
+	out->preempted = stats.preempted;
+	out->wait_avg_ms = stats.started ? (uint32_t)(stats.wait_ticks / stats.started) * portTICK_PERIOD_MS : 0;
+	out->wait_max_ms = stats.wait_max_ticks * portTICK_PERIOD_MS;
+	taskEXIT_CRITICAL();
+}
@@ -18,15 +18,23 @@ Result timer_testing(test_command_t* command){
 	HAL_TIM_Base_Start_IT(&htim7);
 
 	for(uint8_t i=0 ; i< command->iterations ; i++){
+	    if (test_monitor_checkpoint()) {
+	         HAL_TIM_Base_Stop_IT(&htim7);
+	         return TEST_ERR;
+	    }
+	    test_monitor_iteration_start();
 
 	    if (xSemaphoreTake(TimSemHandle, pdMS_TO_TICKS(200)) != pdPASS) {
 //			printf("Fail on iteration %u.\n\r",i+1); // Debug printf
-	         vPortFree(command);
+	         test_monitor_timeout();
+	         // The command belongs to perform_tests(), only stop the timer
+	         HAL_TIM_Base_Stop_IT(&htim7);
 	         return TEST_FAIL;
 	    }
 
 //		printf("success on iteration %u.\n\r", i + 1); // Debug printf
-        osDelay(10); // Small delay between iterations to prevent overwhelming the UUT or the system
+        test_monitor_iteration(i);
+        test_monitor_pace(); // Small delay between iterations to prevent overwhelming the UUT or the system
 	}// end of iterations
 
     // Stop Timer after the test is complete
@@ -0,0 +1,439 @@
+#include "tlv.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Encodes and decodes TLV frames (see tlv.h), without lwIP or the C library's allocator so
+ * the firmware and the host tools share it.
+ *
+ * Compatibility rules: a frame is read as far as this side understands it - unknown TLVs are
+ * skipped and a newer version is accepted - so fields can be added without breaking older
+ * peers. Only a change that older peers must not ignore needs a new message type.
+ */
+
+typedef struct tlv_writer_t {
+    uint8_t *frame;
+    uint16_t size;
+    uint16_t used;
+    uint8_t overflow;
+} tlv_writer_t;
+
+static void tlv_begin(tlv_writer_t *w, void *frame, uint16_t size, uint8_t type)
+{
+    tlv_header_t header = {.tag = TLV_TAG, .zero = 0, .version = PROTOCOL_VERSION, .type = type, .length = 0};
+
+    w->frame = frame;
+    w->size = size;
+    w->used = TLV_HEADER_SIZE;
+    w->overflow = size < TLV_HEADER_SIZE;
+    if (!w->overflow) memcpy(frame, &header, TLV_HEADER_SIZE);
+}
+
+static void tlv_put(tlv_writer_t *w, uint8_t type, const void *value, uint16_t length)
+{
+    if (w->overflow || w->size - w->used < TLV_ITEM_HEADER_SIZE + length) {
+        w->overflow = 1;
+        return;
+    }
+    w->frame[w->used] = type;
+    memcpy(&w->frame[w->used + 1], &length, sizeof(length));
+    memcpy(&w->frame[w->used + TLV_ITEM_HEADER_SIZE], value, length);
+    w->used += TLV_ITEM_HEADER_SIZE + length;
+}
+
+// Fills in the TLV length, returns the frame's size or 0 when it did not fit
+static uint16_t tlv_end(tlv_writer_t *w)
+{
+    uint16_t length = w->used - TLV_HEADER_SIZE;
+
+    if (w->overflow) return 0;
+    memcpy(w->frame + offsetof(tlv_header_t, length), &length, sizeof(length));
+    return w->used;
+}
+
+// Checks the header, returns the TLV bytes that follow it or -1
+static int tlv_open(const void *frame, uint16_t size, tlv_header_t *header)
+{
+    if (size < TLV_HEADER_SIZE) return -1;
+    memcpy(header, frame, TLV_HEADER_SIZE);
+    if (header->tag != TLV_TAG || header->zero != 0 || header->version < 1) return -1;
+    if (header->length > size - TLV_HEADER_SIZE) return -1;
+    return header->length;
+}
+
+// Next TLV at *pos, returns 1, 0 at the end, -1 when a TLV overruns the frame
+static int tlv_next(const uint8_t *tlvs, uint16_t length, uint16_t *pos, uint8_t *type,
+                    const uint8_t **value, uint16_t *value_length)
+{
+    if (*pos == length) return 0;
+    if (length - *pos < TLV_ITEM_HEADER_SIZE) return -1;
+    *type = tlvs[*pos];
+    memcpy(value_length, &tlvs[*pos + 1], sizeof(*value_length));
+    if (length - *pos - TLV_ITEM_HEADER_SIZE < *value_length) return -1;
+    *value = &tlvs[*pos + TLV_ITEM_HEADER_SIZE];
+    *pos += TLV_ITEM_HEADER_SIZE + *value_length;
+    return 1;
+}
+
+/*
+ * @param type: TLV_MSG_CAPS_QUERY or TLV_MSG_STATS_QUERY.
+ * @retval Size of the query, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_query(void *frame, uint16_t size, uint8_t type)
+{
+    tlv_writer_t w;
+    tlv_begin(&w, frame, size, type);
+    return tlv_end(&w);
+}
+
+/*
+ * @retval Size of the capability reply, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_caps(void *frame, uint16_t size, const tlv_caps_t *caps)
+{
+    tlv_writer_t w;
+    tlv_begin(&w, frame, size, TLV_MSG_CAPS);
+    tlv_put(&w, TLV_CAP_VERSION, &caps->version, sizeof(caps->version));
+    tlv_put(&w, TLV_CAP_PERIPHERALS, &caps->peripherals, sizeof(caps->peripherals));
+    tlv_put(&w, TLV_CAP_MAX_PATTERN, &caps->max_pattern, sizeof(caps->max_pattern));
+    tlv_put(&w, TLV_CAP_MAX_BATCH, &caps->max_batch, sizeof(caps->max_batch));
+    tlv_put(&w, TLV_CAP_RESULT_BATCH, &caps->result_batch, sizeof(caps->result_batch));
+    tlv_put(&w, TLV_CAP_FEATURES, &caps->features, sizeof(caps->features));
+    tlv_put(&w, TLV_CAP_BUILD_ID, caps->build_id, (uint16_t)strlen(caps->build_id));
+    return tlv_end(&w);
+}
+
+/*
+ * @brief Encodes a command, its option flags in TLV_OPTIONS.
+ * @param sched: Priority, deadline and soak limits, NULL (or defaults) - not sent.
+ * @retval Size of the frame, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_command(void *frame, uint16_t size, const test_command_t *cmd, const tlv_sched_t *sched)
+{
+    tlv_writer_t w;
+    uint8_t peripheral = cmd->peripheral & PERIPHERAL_MASK;
+    uint8_t options = cmd->peripheral & ~PERIPHERAL_MASK;
+
+    tlv_begin(&w, frame, size, TLV_MSG_COMMAND);
+    tlv_put(&w, TLV_TEST_ID, &cmd->test_id, sizeof(cmd->test_id));
+    tlv_put(&w, TLV_PERIPHERAL, &peripheral, sizeof(peripheral));
+    tlv_put(&w, TLV_ITERATIONS, &cmd->iterations, sizeof(cmd->iterations));
+    tlv_put(&w, TLV_PATTERN, cmd->bit_pattern, cmd->bit_pattern_length);
+    if (options != 0) tlv_put(&w, TLV_OPTIONS, &options, sizeof(options));
+    if (sched != NULL && sched->priority != PRIORITY_DEFAULT) tlv_put(&w, TLV_PRIORITY, &sched->priority, 1);
+    if (sched != NULL && sched->deadline_ms != 0) tlv_put(&w, TLV_DEADLINE, &sched->deadline_ms, 4);
+    if (sched != NULL && sched->soak_iterations != 0) tlv_put(&w, TLV_SOAK_ITERATIONS, &sched->soak_iterations, 4);
+    if (sched != NULL && sched->soak_ms != 0) tlv_put(&w, TLV_SOAK_DURATION, &sched->soak_ms, 4);
+    return tlv_end(&w);
+}
+
+/*
+ * @retval The TLV_MSG_* type of a frame, -1 if it is not a valid TLV frame.
+ */
+int tlv_message_type(const void *frame, uint16_t size)
+{
+    tlv_header_t header;
+    if (tlv_open(frame, size, &header) < 0) return -1;
+    return header.type;
+}
+
+/*
+ * @brief Decodes a capability reply. Capabilities the UUT did not report stay 0.
+ * @retval 0 on success, -1 on a malformed frame.
+ */
+int tlv_decode_caps(const void *frame, uint16_t size, tlv_caps_t *caps)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t type;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != TLV_MSG_CAPS) return -1;
+    memset(caps, 0, sizeof(*caps));
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &type, &value, &value_length)) > 0) {
+        switch (type) {
+        case TLV_CAP_VERSION:      if (value_length >= 1) caps->version = value[0]; break;
+        case TLV_CAP_PERIPHERALS:  if (value_length >= 1) caps->peripherals = value[0]; break;
+        case TLV_CAP_MAX_PATTERN:  if (value_length >= 2) memcpy(&caps->max_pattern, value, 2); break;
+        case TLV_CAP_MAX_BATCH:    if (value_length >= 1) caps->max_batch = value[0]; break;
+        case TLV_CAP_RESULT_BATCH: if (value_length >= 1) caps->result_batch = value[0]; break;
+        case TLV_CAP_FEATURES:     if (value_length >= 4) memcpy(&caps->features, value, 4); break;
+        case TLV_CAP_BUILD_ID:
+            if (value_length > TLV_BUILD_ID_MAX) value_length = TLV_BUILD_ID_MAX;
+            memcpy(caps->build_id, value, value_length);
+            caps->build_id[value_length] = '\0';
+            break;
+        default:
+            break;      // Added by a newer version
+        }
+    }
+    return status;
+}
+
+/*
+ * @brief Decodes a command into a full test_command_t (the rest of the pattern zeroed).
+ * @param sched: Its priority, deadline and soak limits, defaults when not sent. May be NULL.
+ * @retval 0 on success, -1 on a malformed frame or a missing test ID, peripheral or iteration count.
+ */
+int tlv_decode_command(const void *frame, uint16_t size, test_command_t *cmd, tlv_sched_t *sched)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t type, seen = 0, options = 0;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != TLV_MSG_COMMAND) return -1;
+    memset(cmd, 0, sizeof(*cmd));
+    if (sched != NULL) {
+        sched->priority = PRIORITY_DEFAULT;
+        sched->deadline_ms = 0;
+        sched->soak_iterations = 0;
+        sched->soak_ms = 0;
+    }
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &type, &value, &value_length)) > 0) {
+        switch (type) {
+        case TLV_TEST_ID:
+            if (value_length != sizeof(cmd->test_id)) return -1;
+            memcpy(&cmd->test_id, value, sizeof(cmd->test_id));
+            seen |= 1;
+            break;
+        case TLV_PERIPHERAL:
+            if (value_length != 1) return -1;
+            cmd->peripheral |= value[0] & PERIPHERAL_MASK;
+            seen |= 2;
+            break;
+        case TLV_ITERATIONS:
+            if (value_length != 1) return -1;
+            cmd->iterations = value[0];
+            seen |= 4;
+            break;
+        case TLV_PATTERN:
+            if (value_length >= MAX_BIT_PATTERN_LENGTH) return -1;
+            memcpy(cmd->bit_pattern, value, value_length);
+            cmd->bit_pattern_length = (uint8_t)value_length;
+            break;
+        case TLV_OPTIONS:
+            if (value_length >= 1) options = value[0] & ~PERIPHERAL_MASK;
+            break;
+        case TLV_PRIORITY:
+            if (value_length >= 1 && sched != NULL) sched->priority = value[0];
+            break;
+        case TLV_DEADLINE:
+            if (value_length >= 4 && sched != NULL) memcpy(&sched->deadline_ms, value, 4);
+            break;
+        case TLV_SOAK_ITERATIONS:
+            if (value_length >= 4 && sched != NULL) memcpy(&sched->soak_iterations, value, 4);
+            break;
+        case TLV_SOAK_DURATION:
+            if (value_length >= 4 && sched != NULL) memcpy(&sched->soak_ms, value, 4);
+            break;
+        default:
+            break;      // Added by a newer version
+        }
+    }
+    cmd->peripheral |= options;
+    return (status < 0 || seen != 7) ? -1 : 0;
+}
+
+/*
+ * @brief Encodes a cancel or its reply (`type` TLV_MSG_CANCEL/TLV_MSG_CANCELLED).
+ * @param test_id: The test to cancel, 0 - every queued and running test.
+ * @param port: Port the tests were sent from (0 - any), only sent in a TLV_MSG_CANCEL.
+ * @param count: Tests cancelled, only sent in a TLV_MSG_CANCELLED.
+ * @retval Size of the frame, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_cancel(void *frame, uint16_t size, uint8_t type, uint32_t test_id, uint16_t port, uint16_t count)
+{
+    tlv_writer_t w;
+
+    tlv_begin(&w, frame, size, type);
+    tlv_put(&w, TLV_TEST_ID, &test_id, sizeof(test_id));
+    if (type == TLV_MSG_CANCEL) tlv_put(&w, TLV_CONTROLLER_PORT, &port, sizeof(port));
+    if (type == TLV_MSG_CANCELLED) tlv_put(&w, TLV_CANCEL_COUNT, &count, sizeof(count));
+    return tlv_end(&w);
+}
+
+/*
+ * @brief Decodes a cancel or its reply. A missing test ID means every test, a missing count 0.
+ * @param port: Left as is without a TLV_CONTROLLER_PORT, may be NULL for a TLV_MSG_CANCELLED.
+ * @param count: May be NULL for a TLV_MSG_CANCEL.
+ * @retval 0 on success, -1 on a malformed frame or another message type.
+ */
+int tlv_decode_cancel(const void *frame, uint16_t size, uint8_t type, uint32_t *test_id, uint16_t *port, uint16_t *count)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t item;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != type) return -1;
+    *test_id = 0;
+    if (count != NULL) *count = 0;
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &item, &value, &value_length)) > 0) {
+        if (item == TLV_TEST_ID && value_length == sizeof(*test_id)) memcpy(test_id, value, sizeof(*test_id));
+        else if (item == TLV_CONTROLLER_PORT && value_length == sizeof(*port) && port != NULL) memcpy(port, value, sizeof(*port));
+        else if (item == TLV_CANCEL_COUNT && value_length == sizeof(*count) && count != NULL) memcpy(count, value, sizeof(*count));
+    }
+    return status;
+}
+
+/*
+ * @retval Size of the queue statistics reply, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_stats(void *frame, uint16_t size, const tlv_queue_stats_t *stats)
+{
+    tlv_writer_t w;
+    tlv_begin(&w, frame, size, TLV_MSG_STATS);
+    tlv_put(&w, TLV_STAT_DEPTH, &stats->depth, sizeof(stats->depth));
+    tlv_put(&w, TLV_STAT_HIGH_WATER, &stats->high_water, sizeof(stats->high_water));
+    tlv_put(&w, TLV_STAT_QUEUED, &stats->queued, sizeof(stats->queued));
+    tlv_put(&w, TLV_STAT_REJECTED, &stats->rejected, sizeof(stats->rejected));
+    tlv_put(&w, TLV_STAT_EXPIRED, &stats->expired, sizeof(stats->expired));
+    tlv_put(&w, TLV_STAT_PREEMPTED, &stats->preempted, sizeof(stats->preempted));
+    tlv_put(&w, TLV_STAT_WAIT_AVG, &stats->wait_avg_ms, sizeof(stats->wait_avg_ms));
+    tlv_put(&w, TLV_STAT_WAIT_MAX, &stats->wait_max_ms, sizeof(stats->wait_max_ms));
+    if (stats->pool_high_water > 0) {
+        tlv_put(&w, TLV_STAT_POOL_HIGH, &stats->pool_high_water, sizeof(stats->pool_high_water));
+        tlv_put(&w, TLV_STAT_POOL_EXHAUSTED, &stats->pool_exhausted, sizeof(stats->pool_exhausted));
+        tlv_put(&w, TLV_STAT_POOL_COPIED, &stats->pool_copied, sizeof(stats->pool_copied));
+    }
+    return tlv_end(&w);
+}
+
+/*
+ * @brief Decodes a queue statistics reply. Statistics the UUT did not report stay 0.
+ * @retval 0 on success, -1 on a malformed frame.
+ */
+int tlv_decode_stats(const void *frame, uint16_t size, tlv_queue_stats_t *stats)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t type;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != TLV_MSG_STATS) return -1;
+    memset(stats, 0, sizeof(*stats));
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &type, &value, &value_length)) > 0) {
+        switch (type) {
+        case TLV_STAT_DEPTH:      if (value_length >= 1) stats->depth = value[0]; break;
+        case TLV_STAT_HIGH_WATER: if (value_length >= 1) stats->high_water = value[0]; break;
+        case TLV_STAT_QUEUED:     if (value_length >= 4) memcpy(&stats->queued, value, 4); break;
+        case TLV_STAT_REJECTED:   if (value_length >= 4) memcpy(&stats->rejected, value, 4); break;
+        case TLV_STAT_EXPIRED:    if (value_length >= 4) memcpy(&stats->expired, value, 4); break;
+        case TLV_STAT_PREEMPTED:  if (value_length >= 4) memcpy(&stats->preempted, value, 4); break;
+        case TLV_STAT_WAIT_AVG:   if (value_length >= 4) memcpy(&stats->wait_avg_ms, value, 4); break;
+        case TLV_STAT_WAIT_MAX:   if (value_length >= 4) memcpy(&stats->wait_max_ms, value, 4); break;
+        case TLV_STAT_POOL_HIGH:  if (value_length >= 1) stats->pool_high_water = value[0]; break;
+        case TLV_STAT_POOL_EXHAUSTED: if (value_length >= 4) memcpy(&stats->pool_exhausted, value, 4); break;
+        case TLV_STAT_POOL_COPIED: if (value_length >= 4) memcpy(&stats->pool_copied, value, 4); break;
+        default:
+            break;      // Added by a newer version
+        }
+    }
+    return status;
+}
+
+/*
+ * @retval Size of the soak result, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_soak_result(void *frame, uint16_t size, const tlv_soak_result_t *soak)
+{
+    tlv_writer_t w;
+    tlv_begin(&w, frame, size, TLV_MSG_SOAK_RESULT);
+    tlv_put(&w, TLV_TEST_ID, &soak->test_id, sizeof(soak->test_id));
+    tlv_put(&w, TLV_RESULT, &soak->result, sizeof(soak->result));
+    tlv_put(&w, TLV_SOAK_PASSED, &soak->passed, sizeof(soak->passed));
+    tlv_put(&w, TLV_SOAK_FAILED, &soak->failed, sizeof(soak->failed));
+    tlv_put(&w, TLV_SOAK_ELAPSED, &soak->elapsed_ms, sizeof(soak->elapsed_ms));
+    return tlv_end(&w);
+}
+
+/*
+ * @brief Decodes a soak result. Counts the UUT did not report stay 0.
+ * @retval 0 on success, -1 on a malformed frame or a missing test ID or result.
+ */
+int tlv_decode_soak_result(const void *frame, uint16_t size, tlv_soak_result_t *soak)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t type, seen = 0;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != TLV_MSG_SOAK_RESULT) return -1;
+    memset(soak, 0, sizeof(*soak));
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &type, &value, &value_length)) > 0) {
+        switch (type) {
+        case TLV_TEST_ID:      if (value_length >= 4) { memcpy(&soak->test_id, value, 4); seen |= 1; } break;
+        case TLV_RESULT:       if (value_length >= 2) { memcpy(&soak->result, value, 2); seen |= 2; } break;
+        case TLV_SOAK_PASSED:  if (value_length >= 4) memcpy(&soak->passed, value, 4); break;
+        case TLV_SOAK_FAILED:  if (value_length >= 4) memcpy(&soak->failed, value, 4); break;
+        case TLV_SOAK_ELAPSED: if (value_length >= 4) memcpy(&soak->elapsed_ms, value, 4); break;
+        default:
+            break;      // Added by a newer version
+        }
+    }
+    return (status < 0 || seen != 3) ? -1 : 0;
+}
+
+/*
+ * @brief Encodes the refusal of a frame, so the peer can tell an unsupported message from a failed test.
+ * @param refused_type: TLV_MSG_* of the refused frame, 0 if its header was unreadable.
+ * @retval Size of the frame, 0 if `size` is too small.
+ */
+uint16_t tlv_encode_error(void *frame, uint16_t size, uint8_t code, uint8_t refused_type)
+{
+    tlv_writer_t w;
+    tlv_begin(&w, frame, size, TLV_MSG_ERROR);
+    tlv_put(&w, TLV_ERROR_CODE, &code, sizeof(code));
+    tlv_put(&w, TLV_ERROR_TYPE, &refused_type, sizeof(refused_type));
+    return tlv_end(&w);
+}
+
+/*
+ * @brief Decodes the refusal of a frame. A missing type stays 0.
+ * @retval 0 on success, -1 on a malformed frame or a missing code.
+ */
+int tlv_decode_error(const void *frame, uint16_t size, uint8_t *code, uint8_t *refused_type)
+{
+    tlv_header_t header;
+    const uint8_t *value;
+    uint16_t value_length, pos = 0;
+    uint8_t type, seen = 0;
+    int length = tlv_open(frame, size, &header);
+    int status;
+
+    if (length < 0 || header.type != TLV_MSG_ERROR) return -1;
+    *refused_type = 0;
+
+    const uint8_t *tlvs = (const uint8_t *)frame + TLV_HEADER_SIZE;
+    while ((status = tlv_next(tlvs, length, &pos, &type, &value, &value_length)) > 0) {
+        switch (type) {
+        case TLV_ERROR_CODE: if (value_length >= 1) { *code = value[0]; seen = 1; } break;
+        case TLV_ERROR_TYPE: if (value_length >= 1) *refused_type = value[0]; break;
+        default:
+            break;      // Added by a newer version
+        }
+    }
+    return (status < 0 || !seen) ? -1 : 0;
+}
@@ -31,8 +31,10 @@ Result uart_testing(test_command_t* command){
     memcpy(tx_buffer, command->bit_pattern, command->bit_pattern_length);
 
     for(uint8_t i=0 ; i< command->iterations ; i++){
+        if (test_monitor_checkpoint()) return TEST_ERR;
 //        printf("UART_TEST: Iteration %u/%u:\n\r", i + 1, command->iterations); // Debug printf
         memset(rx_buffer, 0, command->bit_pattern_length);
+        test_monitor_iteration_start();
 
         // RECEIVER start to RECEIVE DMA
         rx_status = HAL_UART_Receive_DMA(UART_RECEIVER, echo_buffer, command->bit_pattern_length);
@@ -57,6 +59,7 @@ Result uart_testing(test_command_t* command){
         // WAIT FOR TX COMPLETION
         if (xSemaphoreTake(UartTxHandle, TIMEOUT) != pdPASS) {
              printf("fail to get TxSemaphore\n\r");
+             test_monitor_timeout();
              HAL_UART_Abort(UART_RECEIVER);
              HAL_UART_Abort(UART_SENDER);
              return TEST_FAIL;
@@ -74,6 +77,7 @@ Result uart_testing(test_command_t* command){
         // WAIT FOR RECEIVER RX COMPLETION
         if (xSemaphoreTake(UartRxHandle, TIMEOUT) != pdPASS) {
             printf("fail to get RxSemaphore\n\r");
+            test_monitor_timeout();
             HAL_UART_Abort(UART_SENDER);
             HAL_UART_Abort(UART_RECEIVER);
             return TEST_FAIL;
@@ -87,6 +91,7 @@ Result uart_testing(test_command_t* command){
 			uint32_t sent_crc = calculate_crc(tx_buffer, command->bit_pattern_length);
 			uint32_t received_crc = calculate_crc(rx_buffer, command->bit_pattern_length);
 			if (sent_crc != received_crc) {
+				test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 				// Debug printf
 //				printf("UART_TEST: CRC mismatch on iteration %u. Sent CRC: 0x%lX, Received CRC: 0x%lX\n\r",
 //					   i + 1, sent_crc, received_crc);
@@ -96,6 +101,7 @@ Result uart_testing(test_command_t* command){
 	    else {
 			int comp = memcmp(tx_buffer, rx_buffer, command->bit_pattern_length);
 			if (comp != 0) {
+				test_monitor_mismatch(tx_buffer, rx_buffer, command->bit_pattern_length);
 //				// Debug printf
 //				printf("Data mismatch on iteration %u.\n\r", i + 1);
 //				printf("Sent: %.*s\n\r", command->bit_pattern_length, tx_buffer);
@@ -104,8 +110,9 @@ Result uart_testing(test_command_t* command){
 			}
 	    }
 //	    printf("Data Match on iteration %u.\n\r", i + 1); // Debug printf
+        test_monitor_iteration(i);
 
-        osDelay(10); // Small delay between iterations to prevent overwhelming the UUT or the system
+        test_monitor_pace(); // Small delay between iterations to prevent overwhelming the UUT or the system
 	}
     return TEST_PASS;
 }
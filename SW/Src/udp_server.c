@@ -7,6 +7,63 @@
   * @param 1: Peripheral to test (UART/I2C/SPI/TIMER/ADC)
   * @param 2: Number of iterations to test 
   * @param 3: A testing character pattern - Not mandatory
+  *
+  * Options (before the parameters):
+  * -n count    : Run the test `count` times over one socket (pipelined)
+  * -w window   : Commands kept in flight at once (default PIPELINE_DEFAULT_WINDOW)
+  * -a ip[:port]: UUT address (default CLIENT_IP:CLIENT_PORT), e.g. 127.0.0.1 for uut_emulator
+  * -f uut_list : Fleet mode - run the test `count` times on every UUT listed in the file
+  *               (one ip[:port] per line) concurrently
+  * -j threads  : Network threads the fleet's UUTs are split between (default: one per core)
+  * -s port     : Local port to bind (default SERVER_PORT, 0 - any free port)
+  * -t millis   : How long to wait for a result before resending the command (default PIPELINE_DEFAULT_TIMEOUT)
+  * -r retries  : Resends before a test is reported as timed out, the wait doubles with every
+  *               resend (default PIPELINE_DEFAULT_RETRIES). The UUT never runs a resent test twice.
+  * -B          : Log to the binary RESULT_LOG_FILE instead of testing_log.txt (read it with log_tool)
+  * -H file     : Export the run's latency percentiles per peripheral as CSV
+  *               (runs of more than one test always print them)
+  * -p plan     : Run every test of a plan file (one "PERIPHERAL ITERATIONS [PATTERN|@generator]
+  *               [deadline=millis]" per line, see test_plan.h) instead of the parameters, `count` times
+  * -c          : Compact commands - send only the pattern's bytes instead of the whole
+  *               MAX_BIT_PATTERN_LENGTH array (needs UUT firmware that accepts TEST_COMMAND_SIZE)
+  * -G count    : Pack up to `count` commands (at most COMMAND_BATCH_MAX) into one datagram; the UUT
+  *               answers them with shared result datagrams. Implies -c, resends go out one by one
+  * -m          : Send and receive up to PIPELINE_BATCH datagrams per syscall (sendmmsg/recvmmsg)
+  * -U          : Submit sends and reap results through io_uring (one io_uring_enter() per round,
+  *               multishot receives); falls back to the plain socket calls when the kernel lacks it
+  * -b          : Benchmark - run the tests with one datagram per syscall, batched and on io_uring,
+  *               and compare tests/sec, syscalls and CPU time per test (results are not logged)
+  * -R start:step:max[:seconds]
+  *             : Saturation benchmark - offer the test at `start` commands/sec, then `start + step`
+  *               ... up to `max`, `seconds` per rate, and report accepted/rejected/late commands,
+  *               latency and the knee rate the UUT still keeps up with (results are not logged)
+  * -P          : Stream progress - the UUT reports every finished iteration while a test runs
+  *               (STREAM_PROGRESS), printed as it arrives when testing a single UUT
+  * -X          : Extended results - the UUT reports the failing iteration and byte, the kind of
+  *               failure and its min/avg/max transfer times (EXTENDED_RESULT), printed per test
+  * -Q          : Query the UUTs' capabilities first (protocol version, peripherals, limits,
+  *               firmware build) and turn off the options not every UUT supports
+  * -T          : Send the commands as versioned TLV frames (see tlv.h) instead of test_command_t
+  * -y priority : Queue priority of the tests on the UUT (implies -T, default PRIORITY_DEFAULT). A test
+  *               of higher priority runs first, and preempts a running one of another peripheral at
+  *               its next iteration; plan deadlines are sent too, a test not started by its deadline
+  *               is answered with TEST_ERR
+  * -S iterations: Soak - run the test back to back for up to 2^32-1 iterations instead of
+  *               ITERATIONS (implies -T); the UUT reports the passed and failed iterations and the
+  *               time taken, printed with the iteration and byte rates. The command is resent
+  *               until the soak ends (the UUT ignores resends while it runs): it never times out,
+  *               so interrupt the client if the UUT stops answering
+  * -D seconds  : Soak for this long (implies -T); with -S the soak ends at whichever comes first
+  * -I          : Print the test queue statistics of the UUT - or every UUT of the fleet - (depth,
+  *               rejected, expired and preempted tests, wait times, and the command descriptor
+  *               pool's high water mark, exhaustion and copies) instead of running a test
+  * -C id|all   : Cancel a queued or running test (all of them) on the UUT - or every UUT of the
+  *               fleet - instead of running one. A running test stops before its next iteration,
+  *               its controller and those of dropped queued tests get TEST_ERR. Only tests this
+  *               host sent from the -s port are cancelled (from any port with -s 0 or a fleet),
+  *               those of other controllers keep running
+  * -K          : Also measure round trips between the kernel's software send/receive timestamps,
+  *               reported next to the user space times
   * @retval None
   */
 #include <stddef.h>
@@ -14,116 +71,376 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <unistd.h>
+#include <poll.h>
 
-#include "Project_header.h"
-#define COUNT_FILE "calls_count.txt"
+#include "project_header.h"
+#include "pipeline.h"
+#include "fleet.h"
+#include "id_alloc.h"
+#include "result_log.h"
+#include "latency_hist.h"
+#include "test_plan.h"
+#include "saturation.h"
+#include "outcome_queue.h"
+#include "caps.h"
 #define LOG_FILE "testing_log.txt"
 #define COMMAND_ERR 0
+#define BENCH_PASSES 3      // sendto/recvfrom, sendmmsg/recvmmsg, io_uring
 
 test_command_t test_request_init(int argc, char *argv[]);
 int get_id_num();
 int file_exists(const char *filename);
 void logging(result_pro_t result, struct timeval sent, double duration);
 
+// State shared by every outcome of a run
+typedef struct run_context_t {
+    result_log_t *binary_log;                   // -B, NULL for the text log
+    latency_hist_t latency[PERIPHERAL_COUNT];   // Round trip times per peripheral
+    latency_hist_t kernel_latency[PERIPHERAL_COUNT]; // -K, round trips between kernel timestamps
+    int kernel_timestamps;
+    test_plan_t *plan;                          // -p, NULL for a single test
+    const test_command_t *commands;             // Maps an outcome back to its plan entry
+} run_context_t;
+
+void log_outcome(const test_outcome_t *outcome, void *ctx);
+void print_detail(const test_outcome_t *outcome);
+void print_soak(const test_outcome_t *outcome);
+void print_progress(const test_progress_t *progress, void *ctx);
+int report_latency(const run_context_t *run, const char *export_file);
+int run_benchmark(int sockfd, const struct sockaddr_in *uut_addr, const test_command_t *commands, size_t count,
+                  const pipeline_config_t *config);
+int negotiate_caps(int sockfd, const fleet_t *fleet, const struct sockaddr_in *uut_addr,
+                   pipeline_config_t *config, test_command_t *commands, size_t count);
+int cancel_tests(int sockfd, const struct sockaddr_in *uut_addr, uint32_t test_id, uint16_t tests_port);
+int print_queue_stats(int sockfd, const struct sockaddr_in *uut_addr);
+
 int main(int argc, char *argv[])
 {
-    // Check the amount of arguments that were provided besides the program name
-    if (argc < 3) {
+    long count = 1;
+    long window = PIPELINE_DEFAULT_WINDOW;
+    long local_port = SERVER_PORT;
+    long timeout_ms = PIPELINE_DEFAULT_TIMEOUT;
+    long retries = PIPELINE_DEFAULT_RETRIES;
+    int kernel_timestamps = 0;
+    int batch_io = 0;
+    int io_uring = 0;
+    int compact = 0;
+    int stream_progress = 0;
+    int extended = 0;
+    int query_caps = 0;
+    int tlv = 0;
+    long priority = PRIORITY_DEFAULT;
+    unsigned long long soak_iterations = 0;
+    double soak_seconds = 0;
+    int queue_stats = 0;
+    long frame_commands = 0;
+    int bench = 0;
+    const char *ramp_text = NULL;
+    saturation_config_t ramp;
+    const char *uut_text = NULL;
+    const char *fleet_file = NULL;
+    long threads = 0;
+    int binary = 0;
+    const char *hist_file = NULL;
+    const char *plan_file = NULL;
+    const char *cancel_text = NULL;
+    unsigned long cancel_id = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:a:s:t:r:f:j:p:BH:KPXQTy:S:D:IC:mUbcG:R:")) != -1) {
+        switch (opt) {
+        case 'n': count = atol(optarg); break;
+        case 'w': window = atol(optarg); break;
+        case 'a': uut_text = optarg; break;
+        case 's': local_port = atol(optarg); break;
+        case 't': timeout_ms = atol(optarg); break;
+        case 'r': retries = atol(optarg); break;
+        case 'f': fleet_file = optarg; break;
+        case 'j': threads = atol(optarg); break;
+        case 'B': binary = 1; break;
+        case 'H': hist_file = optarg; break;
+        case 'K': kernel_timestamps = 1; break;
+        case 'P': stream_progress = 1; break;
+        case 'X': extended = 1; break;
+        case 'Q': query_caps = 1; break;
+        case 'T': tlv = 1; break;
+        case 'y': priority = atol(optarg); tlv = 1; break;
+        case 'S': soak_iterations = strtoull(optarg, NULL, 10); tlv = 1; break;
+        case 'D': soak_seconds = atof(optarg); tlv = 1; break;
+        case 'I': queue_stats = 1; break;
+        case 'C': cancel_text = optarg; break;
+        case 'p': plan_file = optarg; break;
+        case 'm': batch_io = 1; break;
+        case 'U': io_uring = 1; break;
+        case 'c': compact = 1; break;
+        case 'G': frame_commands = atol(optarg); break;
+        case 'b': bench = 1; break;
+        case 'R': ramp_text = optarg; break;
+        default:
+            printf("Usage: %s [-n count] [-w window] [-a ip[:port] | -f uut_list [-j threads]] [-s port] [-t millis] [-r retries] [-B] [-H latency.csv] [-K] [-P] [-X] [-Q] [-T] [-y priority] [-S iterations] [-D seconds] [-c] [-G count] [-m | -U | -b | -R start:step:max[:seconds]] PERIPHERAL ITERATIONS [PATTERN] | -p plan | -C id|all | -I\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count < 1 || window < 1 || timeout_ms < 1 || retries < 0 || retries > 255 || threads < 0 || local_port < 0 || local_port > 65535 ||
+        priority < 0 || priority > 255 || soak_iterations > UINT32_MAX || soak_seconds < 0 || soak_seconds > UINT32_MAX / 1000.0) {
+        printf("Invalid option value\n");
+        return 1;
+    }
+    if ((bench || ramp_text != NULL) && fleet_file != NULL) {
+        printf("The benchmark runs against a single UUT\n");
+        return 1;
+    }
+    if (ramp_text != NULL && saturation_parse(ramp_text, &ramp) < 0) {
+        printf("Invalid rate ramp: %s\n", ramp_text);
+        return 1;
+    }
+    if (cancel_text != NULL && strcmp(cancel_text, "all") != 0) {
+        char *end;
+        cancel_id = strtoul(cancel_text, &end, 10);
+        if (*end != '\0' || cancel_id == 0 || cancel_id >= BATCH_TAG_FIRST) {
+            printf("Invalid test ID to cancel: %s\n", cancel_text);
+            return 1;
+        }
+    }
+
+    // Check the amount of arguments that were provided besides the program name and options
+    int params = argc - optind;
+    if (plan_file != NULL || cancel_text != NULL || queue_stats) {
+        if (params > 0) {
+            printf("A test plan, cancel or queue statistics replace the test parameters\n");
+            return 1;
+        }
+    }
+    else if (params < 2) {
         printf("Not enough arguments: Please specify a Peripheral, and number of iterations to check and a pattern\n");
         return 1;
     }
-    else if(argc > 4){
+    else if(params > 3){
         printf("Too many arguments\n");
         return 1;
     }
 
-    int sockfd;
+    int sockfd = -1;
     struct sockaddr_in server_addr, uut_addr;
-    socklen_t addr_len = sizeof(uut_addr);
+    fleet_t fleet;
+    size_t uut_count = 1;
 
-    // Create a UDP socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0){
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+    if (fleet_file != NULL) {
+        if (fleet_load(&fleet, fleet_file) < 0) {
+            fleet_free(&fleet);
+            return 1;
+        }
+        uut_count = fleet.count;
+    }
+    else {
+        // Set STM32 target address
+        if (uut_text == NULL) {
+            memset(&uut_addr, 0, sizeof(uut_addr));
+            uut_addr.sin_family = AF_INET;
+            uut_addr.sin_port = htons(CLIENT_PORT);  // Port STM32 is listening on
+            // STM32 IP address:
+            uut_addr.sin_addr.s_addr = inet_addr(CLIENT_IP);
+        }
+        else if (parse_address(uut_text, &uut_addr) < 0) {
+            printf("Invalid UUT address: %s\n", uut_text);
+            return 1;
+        }
+
+        // Create a UDP socket
+        if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0){
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // Set up server address structure
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        // A cancel is sent next to the run holding local_port, and names that port instead
+        server_addr.sin_port = htons(cancel_text != NULL ? 0 : local_port);
+
+        // Bind the socket to the server address
+        if (bind(sockfd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0){
+            perror("Bind failed");
+            close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+
+        if (cancel_text == NULL) printf("UDP server on port %ld.\n", local_port);
+    }
+
+    if (cancel_text != NULL || queue_stats) {
+        int status = 0;
+        // The fleet's own sockets only exist while fleet_run() runs
+        if (fleet_file != NULL && (sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+            perror("Socket creation failed");
+            status = -1;
+        }
+        for (size_t i = 0; sockfd >= 0 && i < uut_count; i++) {
+            const struct sockaddr_in *addr = fleet_file ? &fleet.uuts[i].addr : &uut_addr;
+            // The fleet's sockets have any free port
+            uint16_t tests_port = fleet_file ? 0 : (uint16_t)local_port;
+            if ((cancel_text != NULL ? cancel_tests(sockfd, addr, cancel_id, tests_port) : print_queue_stats(sockfd, addr)) < 0) status = -1;
+        }
+        if (fleet_file != NULL) fleet_free(&fleet);
+        if (sockfd >= 0) close(sockfd);
+        return status < 0 ? 1 : 0;
     }
 
-    // Set up server address structure
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(SERVER_PORT);
+    int status = -1;
+    test_command_t *commands = NULL;
+    unsigned *deadlines = NULL;
+    test_plan_t plan = {0};
+    run_context_t *run = malloc(sizeof(run_context_t));
+    if (run == NULL) {
+        perror("Error: Could not allocate the run context");
+        goto cleanup;
+    }
+    run->binary_log = NULL;
+    run->kernel_timestamps = kernel_timestamps;
+    run->plan = NULL;
+    for (int i = 0; i < PERIPHERAL_COUNT; i++) {
+        hist_init(&run->latency[i]);
+        hist_init(&run->kernel_latency[i]);
+    }
 
-    // Bind the socket to the server address
-    if (bind(sockfd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0){
-        perror("Bind failed");
-        close(sockfd);
-        exit(EXIT_FAILURE);
+    if (id_alloc_open(ID_FILE, ID_LEGACY_FILE) < 0) goto cleanup;
+    if (binary) {
+        run->binary_log = malloc(sizeof(result_log_t));
+        if (run->binary_log == NULL || result_log_open(run->binary_log, RESULT_LOG_FILE) < 0) {
+            free(run->binary_log);
+            run->binary_log = NULL;
+            goto cleanup;
+        }
     }
 
-    printf("UDP server on port %d.\n", SERVER_PORT);
-    
-    test_command_t test_pack = test_request_init(argc,argv);
-    if (test_pack.peripheral == COMMAND_ERR || test_pack.iterations == COMMAND_ERR) return 1;
-    
-    result_pro_t result_pack;
-    FILE * logging_fd;
-    uint8_t i;
-
-    // Set STM32 target address
-    memset(&uut_addr, 0, sizeof(uut_addr));
-    uut_addr.sin_family = AF_INET;
-    uut_addr.sin_port = htons(5005);  // Port STM32 is listening on
-
-    // STM32 IP address:
-    uut_addr.sin_addr.s_addr = inet_addr(CLIENT_IP);
-
-    struct timeval sent_time;
-    struct timeval recv_time;
-    double sent_sec, test_len;
-
-    // Send message
-    ssize_t sent_bytes = sendto(sockfd, (const void *)&test_pack, sizeof(test_pack), 0,
-                            (struct sockaddr*)&uut_addr, sizeof(uut_addr));
-    if (sent_bytes < 0) 
-    {
-        perror("sendto failed");
-        close(sockfd);
-        return 1;
+    test_command_t test_pack;
+    size_t first = 0;                   // Commands that already have an ID
+    size_t per_round = 1;               // Commands of one repetition
+    if (plan_file != NULL) {
+        if (plan_load(&plan, plan_file) < 0) goto cleanup;
+        per_round = plan.count;
+        run->plan = &plan;
+        printf("Running %zu tests of %s:\n", plan.count, plan_file);
     }
     else {
-        // Get the current time
-        gettimeofday(&sent_time, NULL);
-        sent_sec = sent_time.tv_sec + (double)sent_time.tv_usec / 1000000.0;
-    }
-      
-    // Receive message from UUT
-    int n = recvfrom(sockfd, &result_pack, sizeof(result_pro_t), 0, (struct sockaddr *)&uut_addr, &addr_len);
-    if (n < 0){
-        perror("Receive failed\n");
-        close(sockfd);
-        return 1;
+        // test_request_init() expects the peripheral at argv[1]
+        test_pack = test_request_init(params + 1, argv + optind - 1);
+        if (test_pack.peripheral == COMMAND_ERR || test_pack.iterations == COMMAND_ERR || test_pack.test_id == 0) goto cleanup;
+        first = 1;
     }
-    else{
-        gettimeofday(&recv_time, NULL);
-        test_len = (recv_time.tv_sec + (double)recv_time.tv_usec / 1000000.0) - sent_sec;
+
+    // Every repetition (on every UUT, in every benchmark pass) is the same test or plan under new IDs
+    // The saturation benchmark takes one round as its templates and allocates its own IDs
+    size_t per_uut = (ramp_text != NULL) ? per_round : count * per_round;
+    size_t total = per_uut * uut_count * (bench ? BENCH_PASSES : 1);
+    commands = malloc(total * sizeof(test_command_t));
+    if (commands == NULL || (run->plan != NULL && (deadlines = malloc(total * sizeof(unsigned))) == NULL)) {
+        perror("Error: Could not allocate the commands");
+        goto cleanup;
     }
-   
-    logging(result_pack, sent_time, test_len);
-    close(sockfd);
-    return 0;
+    run->commands = commands;
+    if (first) commands[0] = test_pack;
+    if (total > first) {
+        // One reservation for the whole run instead of a counter update per test
+        uint32_t first_id = id_alloc_reserve(total - first);
+        if (first_id == 0) goto cleanup;
+        printf("Test IDs %u-%u:\n", first_id, (uint32_t)(first_id + total - first - 1));
+        for (size_t i = first; i < total; i++) {
+            commands[i] = run->plan ? plan.entries[i % plan.count].command : test_pack;
+            commands[i].test_id = first_id + i - first;
+            if (deadlines) deadlines[i] = plan.entries[i % plan.count].deadline_ms;
+        }
+    }
+    for (size_t i = 0; stream_progress && i < total; i++) commands[i].peripheral |= STREAM_PROGRESS;
+    for (size_t i = 0; extended && i < total; i++) commands[i].peripheral |= EXTENDED_RESULT;
+
+    pipeline_config_t config;
+    pipeline_config_default(&config);
+    config.window = window;
+    config.timeout_ms = timeout_ms;
+    config.retries = retries;
+    config.kernel_timestamps = kernel_timestamps;
+    config.batch_io = batch_io;
+    config.io_uring = io_uring;
+    config.compact = compact;
+    config.frame_commands = frame_commands > 0 ? frame_commands : 0;
+    config.tlv = tlv;
+    config.priority = (uint8_t)priority;
+    config.soak_iterations = (uint32_t)soak_iterations;
+    config.soak_ms = (unsigned)(soak_seconds * 1000);
+    if (query_caps && negotiate_caps(sockfd, fleet_file ? &fleet : NULL, &uut_addr, &config, commands, total) < 0) goto cleanup;
+
+    double started = time_now();
+    if (ramp_text != NULL) {
+        status = saturation_run(sockfd, &uut_addr, commands, per_uut, &ramp, &config);
+    }
+    else if (bench) {
+        status = run_benchmark(sockfd, &uut_addr, commands, per_uut, &config);
+    }
+    else if (fleet_file != NULL) {
+        fleet.threads = threads;
+        status = fleet_run(&fleet, commands, deadlines, per_uut, &config, log_outcome, run);
+        fleet_report(&fleet, time_now() - started);
+        for (size_t i = 0; i < fleet.count; i++) {
+            if (fleet.uuts[i].pipeline.timeouts > 0) status = -1;
+        }
+    }
+    else {
+        pipeline_t pipeline;
+        outcome_queue_t queue;
+        // Logging runs on its own thread, the pipeline only queues the outcomes
+        if (outcome_queue_start(&queue, 1, log_outcome, run) < 0) goto cleanup;
+        if (pipeline_init(&pipeline, sockfd, &uut_addr, commands, per_uut, &config, outcome_ring_push,
+                          outcome_queue_ring(&queue, 0)) < 0) {
+            outcome_queue_stop(&queue);
+            goto cleanup;
+        }
+        pipeline_set_deadlines(&pipeline, deadlines);
+        if (stream_progress) pipeline_set_progress(&pipeline, print_progress);
+
+        status = pipeline_run(&pipeline);
+        double elapsed = time_now() - started;
+        if (outcome_queue_stop(&queue) < 0) status = -1;
+
+        if (per_uut > 1 || run->binary_log != NULL) {
+            printf("%zu tests in %.3f s (%.1f tests/sec): %zu passed, %zu failed, %zu errors, %zu timed out, %zu resent\n",
+                   pipeline.completed, elapsed, elapsed > 0 ? pipeline.completed / elapsed : 0.0,
+                   pipeline.passed, pipeline.failed, pipeline.errors, pipeline.timeouts, pipeline.retransmits);
+            printf("%zu syscalls (%.2f per test), %.1f bytes per command\n", pipeline.syscalls,
+                   pipeline.completed ? (double)pipeline.syscalls / pipeline.completed : 0.0,
+                   pipeline.completed ? (double)pipeline.bytes_sent / pipeline.completed : 0.0);
+        }
+        if (pipeline.timeouts > 0) status = -1;
+        pipeline_free(&pipeline);
+    }
+
+    if (run->plan != NULL && ramp_text == NULL) plan_report(stdout, run->plan, time_now() - started);
+    if (!bench && ramp_text == NULL && (total > 1 || hist_file != NULL) && report_latency(run, hist_file) < 0) status = -1;
+
+cleanup:
+    if (run != NULL && run->binary_log != NULL) {
+        if (result_log_close(run->binary_log) < 0) status = -1;
+        free(run->binary_log);
+    }
+    free(run);
+    free(commands);
+    free(deadlines);
+    plan_free(&plan);
+    if (fleet_file != NULL) fleet_free(&fleet);
+    if (sockfd >= 0) close(sockfd);
+    id_alloc_close();
+    return status < 0 ? 1 : 0;
 }
 
 test_command_t test_request_init(int argc, char *argv[]){
     
     test_command_t test_request;
 
-    if (strcmp(argv[1], "TIMER") == 0) test_request.peripheral =  TIMER;
-    else if (strcmp(argv[1], "UART") == 0) test_request.peripheral = UART;
-    else if (strcmp(argv[1], "SPI") == 0) test_request.peripheral = SPI;
-    else if (strcmp(argv[1], "I2C") == 0) test_request.peripheral = I2C;
-    else if (strcmp(argv[1], "ADC") == 0) test_request.peripheral = ADC_P;
-    else {
+    test_request.peripheral = peripheral_by_name(argv[1]);
+    if (test_request.peripheral == 0) {
         printf("Invalid peripheral input.\n");
         test_request.peripheral = COMMAND_ERR;
         return test_request; 
@@ -156,36 +473,13 @@ test_command_t test_request_init(int argc, char *argv[]){
 }
 
 int get_id_num(){
-    FILE *file_ptr;
-    int current_count = 0;
-
-    if (file_exists(COUNT_FILE)) {
-        // Open the file in read mode.
-        file_ptr = fopen(COUNT_FILE, "r");
-        fscanf(file_ptr, "%d", &current_count);
-        // Close the file after reading.
-        fclose(file_ptr);
-    }
-    // If the file doesn't exist yet (this is the first run), so we'll start with the default count of 0.
-
-    // Increment the count and print the result
-    current_count++;
-    printf("Test ID %d:\n", current_count);
-    
-    // Write the new count back to the file
-    file_ptr = fopen(COUNT_FILE, "w");
-
-    // Check if the file was opened for writing successfully.
-    if (file_ptr != NULL) {
-        // Write the new count back to the file.
-        fprintf(file_ptr, "%d", current_count);
-        // Close the file after writing.
-        fclose(file_ptr);
-    } else {
-        // Handle the case where the file can't be created or written to.
-        perror("Error: Could not write to the count file.");
-        return 1;
+    // One atomic increment of the shared counter, safe with parallel clients
+    uint32_t current_count = id_alloc_next();
+    if (current_count == 0) {
+        printf("Error: The test ID counter is not available\n");
+        return 0;
     }
+    printf("Test ID %u:\n", current_count);
     return current_count;
 }
 
@@ -195,6 +489,181 @@ int file_exists(const char *filename) {
     return (stat(filename, &buffer) == 0);
 }
 
+// Pipeline callback: every result (or timeout) is logged as it arrives
+// ctx: the run_context_t of the run
+void log_outcome(const test_outcome_t *outcome, void *ctx){
+    run_context_t *run = ctx;
+
+    if (outcome->timed_out) {
+        printf("Test ID %u: no result within the timeout\n", outcome->command->test_id);
+    }
+    else {
+        int slot = peripheral_slot(outcome->command->peripheral);
+        if (slot >= 0) hist_record(&run->latency[slot], (uint64_t)(outcome->duration * 1e9));
+        if (slot >= 0 && outcome->kernel_duration >= 0) {
+            hist_record(&run->kernel_latency[slot], (uint64_t)(outcome->kernel_duration * 1e9));
+        }
+        if (run->binary_log == NULL && outcome->kernel_duration >= 0) {
+            printf("Kernel round trip %.6f s (user space %.6f s)\n", outcome->kernel_duration, outcome->duration);
+        }
+        if (outcome->extended) print_detail(outcome);
+        if (outcome->soaked) print_soak(outcome);
+    }
+    if (run->plan != NULL) plan_record(run->plan, (outcome->command - run->commands) % run->plan->count, outcome);
+    if (run->binary_log != NULL) result_log_append(run->binary_log, outcome);
+    else logging(outcome->result, outcome->sent, outcome->duration);
+}
+
+// -X: where a test failed and how long its transfers took
+void print_detail(const test_outcome_t *outcome){
+    const result_ext_t *ext = &outcome->detail;
+
+    printf("Test ID %u: %u/%u iterations passed, transfers min %u / avg %u / max %u us\n", ext->test_id,
+           ext->iterations_passed, outcome->command->iterations, ext->min_us, ext->avg_us, ext->max_us);
+    switch (ext->failure) {
+    case FAILURE_TIMEOUT:
+        printf("  failed in iteration %u: transfer timed out\n", ext->iterations_passed + 1);
+        break;
+    case FAILURE_DATA:
+        printf("  failed in iteration %u: byte %u sent as 0x%02X, received as 0x%02X\n", ext->iterations_passed + 1,
+               ext->mismatch_offset, ext->expected, ext->actual);
+        break;
+    case FAILURE_PERIPHERAL:
+        printf("  failed in iteration %u: peripheral error\n", ext->iterations_passed + 1);
+        break;
+    case FAILURE_INVALID:
+        printf("  not run: invalid command\n");
+        break;
+    case FAILURE_CANCELLED:
+        printf("  cancelled after %u iterations\n", ext->iterations_passed);
+        break;
+    case FAILURE_EXPIRED:
+        printf("  not run: its deadline passed while it was queued\n");
+        break;
+    default:
+        break;
+    }
+}
+
+// -S/-D: the counts of a soak and the rates it ran at
+void print_soak(const test_outcome_t *outcome){
+    const tlv_soak_result_t *soak = &outcome->soak;
+    double elapsed = soak->elapsed_ms / 1000.0;
+    uint64_t iterations = (uint64_t)soak->passed + soak->failed;
+
+    printf("Test ID %u: soak of %llu iterations in %.3f s: %u passed, %u failed", soak->test_id,
+           (unsigned long long)iterations, elapsed, soak->passed, soak->failed);
+    if (elapsed > 0) {
+        printf(", %.1f iterations/sec, %.0f bytes/sec", iterations / elapsed,
+               (double)soak->passed * outcome->command->bit_pattern_length / elapsed);
+    }
+    if (soak->result == TEST_ERR) printf(" (cancelled)");
+    printf("\n");
+}
+
+// Pipeline callback of -P: one line per progress frame, with the rate the iterations run at
+void print_progress(const test_progress_t *progress, void *ctx){
+    const progress_record_t *last = &progress->records[progress->count - 1];
+    double elapsed = last->elapsed_us / 1e6;
+    (void)ctx;
+
+    printf("Test ID %u: iteration %u/%u %s after %.3f s (%.1f iterations/sec)\n",
+           progress->command->test_id, last->iteration + 1, progress->iterations,
+           last->status == PROGRESS_PASSED ? "passed" : "FAILED", elapsed,
+           elapsed > 0 ? (last->iteration + 1) / elapsed : 0.0);
+}
+
+// Prints the latency percentiles of the run and optionally exports them as CSV
+int report_latency(const run_context_t *run, const char *export_file){
+    if (run->kernel_timestamps) printf("User space round trips:\n");
+    hist_print_header(stdout);
+    for (int i = 0; i < PERIPHERAL_COUNT; i++) {
+        hist_print(stdout, peripheral_name(peripheral_at(i)), &run->latency[i]);
+    }
+    if (run->kernel_timestamps) {
+        // The difference to the table above is the client's own scheduling and syscall overhead
+        printf("Kernel timestamped round trips:\n");
+        hist_print_header(stdout);
+        for (int i = 0; i < PERIPHERAL_COUNT; i++) {
+            hist_print(stdout, peripheral_name(peripheral_at(i)), &run->kernel_latency[i]);
+        }
+    }
+    if (export_file == NULL) return 0;
+
+    FILE *export_fd = fopen(export_file, "w");
+    if (export_fd == NULL) {
+        perror("Error: Could not open the latency export file");
+        return -1;
+    }
+    hist_export_header(export_fd);
+    for (int i = 0; i < PERIPHERAL_COUNT; i++) {
+        hist_export(export_fd, peripheral_name(peripheral_at(i)), &run->latency[i]);
+    }
+    for (int i = 0; run->kernel_timestamps && i < PERIPHERAL_COUNT; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s/kernel", peripheral_name(peripheral_at(i)));
+        hist_export(export_fd, name, &run->kernel_latency[i]);
+    }
+    fclose(export_fd);
+    return 0;
+}
+
+// Benchmark callback: latency only, logging would dominate the measurement
+// ctx: the latency_hist_t of the pass
+static void bench_outcome(const test_outcome_t *outcome, void *ctx){
+    if (!outcome->timed_out) hist_record(ctx, (uint64_t)(outcome->duration * 1e9));
+}
+
+// User plus system CPU time of the process, in seconds
+static double cpu_time(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Runs `count` commands per datagram, the next `count` batched, the last `count` on io_uring, and compares the passes
+int run_benchmark(int sockfd, const struct sockaddr_in *uut_addr, const test_command_t *commands, size_t count,
+                  const pipeline_config_t *config){
+    static const char *modes[BENCH_PASSES] = {"sendto/recvfrom", "sendmmsg/recvmmsg", "io_uring"};
+    static latency_hist_t latency;
+    pipeline_config_t pass_config = *config;
+    int status = 0;
+
+    printf("%-18s %8s %9s %11s %9s %13s %12s %9s %9s %8s\n", "Mode", "Tests", "Time (s)", "Tests/sec", "Syscalls",
+           "Syscalls/test", "CPU us/test", "p50 (ms)", "p99 (ms)", "Timeouts");
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        pipeline_t pipeline;
+
+        hist_init(&latency);
+        pass_config.batch_io = (pass == 1);
+        pass_config.io_uring = (pass == 2);
+        if (pipeline_init(&pipeline, sockfd, uut_addr, commands + pass * count, count, &pass_config,
+                          bench_outcome, &latency) < 0) {
+            return -1;
+        }
+        if (pass_config.io_uring && pipeline.ring == NULL) {
+            printf("%-18s not available\n", modes[pass]);
+            pipeline_free(&pipeline);
+            continue;
+        }
+
+        double cpu_started = cpu_time();
+        double started = time_now();
+        if (pipeline_run(&pipeline) < 0) status = -1;
+        double elapsed = time_now() - started;
+        double cpu = cpu_time() - cpu_started;
+
+        printf("%-18s %8zu %9.3f %11.1f %9zu %13.2f %12.2f %9.3f %9.3f %8zu\n", modes[pass], pipeline.completed,
+               elapsed, elapsed > 0 ? pipeline.completed / elapsed : 0.0, pipeline.syscalls,
+               pipeline.completed ? (double)pipeline.syscalls / pipeline.completed : 0.0,
+               pipeline.completed ? cpu * 1e6 / pipeline.completed : 0.0,
+               hist_percentile(&latency, 50.0) / 1e6, hist_percentile(&latency, 99.0) / 1e6, pipeline.timeouts);
+        if (pipeline.timeouts > 0) status = -1;
+        pipeline_free(&pipeline);
+    }
+    return status;
+}
+
 // Logging:
 void logging(result_pro_t result, struct timeval sent, double duration){
 
@@ -203,7 +672,7 @@ void logging(result_pro_t result, struct timeval sent, double duration){
     // Create a buffer to hold the formatted string
     char time_str[100];
     // Format the date and time part using strftime()
-    strftime(time_str, sizeof(time_str), "%d-%m-%Y %H:%M:%S", tm_info);
+    strftime(time_str, sizeof(time_str), LOG_TIME_FORMAT, tm_info);
 
     const char *result_str;
     switch (result.test_result)
@@ -230,7 +699,7 @@ void logging(result_pro_t result, struct timeval sent, double duration){
     if (!file_exists(LOG_FILE)) {
         logging_fd = fopen(LOG_FILE, "w");
         if (logging_fd) {
-            fprintf(logging_fd, "%-9s %-25s %-15s %s\n", "Test ID", "Sent At", "Result", "Duration (s)");
+            fprintf(logging_fd, LOG_HEADER_FORMAT, "Test ID", "Sent At", "Result", "Duration (s)");
             fclose(logging_fd);
         } else {
             perror("Error: Could not open log file for writing header");
@@ -242,10 +711,163 @@ void logging(result_pro_t result, struct timeval sent, double duration){
 
     logging_fd = fopen(LOG_FILE, "a");
     if (logging_fd) {
-        fprintf(logging_fd, "%-9d %-25s %-15s %f\n", result.test_id, time_str, result_str, duration);
+        fprintf(logging_fd, LOG_LINE_FORMAT, result.test_id, time_str, result_str, duration);
         fflush(logging_fd);
         fclose(logging_fd);
     } else {
         perror("Error: Could not open log file for appending");
     }   
-}
\ No newline at end of file
+}
+
+/*
+ * @brief -Q: Asks the UUTs for their capabilities and turns off the options not all of them support.
+ * @param fleet: The UUTs to ask, NULL - only uut_addr (over sockfd).
+ * @retval 0 on success, -1 on a socket error or a test the UUTs cannot run.
+ */
+int negotiate_caps(int sockfd, const fleet_t *fleet, const struct sockaddr_in *uut_addr,
+                   pipeline_config_t *config, test_command_t *commands, size_t count)
+{
+    size_t uut_count = fleet ? fleet->count : 1;
+    int query_fd = sockfd;
+    int status = -1;
+    tlv_caps_t common;
+
+    caps_uut_t *uuts = calloc(uut_count, sizeof(caps_uut_t));
+    if (uuts == NULL) {
+        perror("Error: Could not allocate the capability table");
+        return -1;
+    }
+    for (size_t i = 0; i < uut_count; i++) uuts[i].addr = fleet ? fleet->uuts[i].addr : *uut_addr;
+
+    // The fleet's own sockets only exist while fleet_run() runs
+    if (fleet != NULL && (query_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("Socket creation failed");
+        free(uuts);
+        return -1;
+    }
+
+    if (caps_query(query_fd, uuts, uut_count, CAPS_DEFAULT_TIMEOUT, CAPS_DEFAULT_RETRIES) == 0) {
+        for (size_t i = 0; i < uut_count; i++) caps_print(stdout, &uuts[i]);
+        int missing = caps_common(uuts, uut_count, &common);
+        status = caps_apply(missing > 0 ? NULL : &common, config, commands, count);
+    }
+
+    if (query_fd != sockfd) close(query_fd);
+    free(uuts);
+    return status;
+}
+
+#define TLV_REFUSED (-2)
+
+// Firmware older than TLV_MSG_ERROR answers a frame it cannot read with test_id 0 and TEST_ERR;
+// any other plain result is a late answer to a test and is skipped
+static int legacy_refusal(const unsigned char *reply, ssize_t n)
+{
+    result_pro_t result;
+
+    if (n != sizeof(result)) return 0;
+    memcpy(&result, reply, sizeof(result));
+    return result.test_id == 0 && result.test_result == TEST_ERR;
+}
+
+/*
+ * @brief Sends a TLV request to one UUT, resending it until a `reply_type` frame comes back.
+ * @param attempts: Set to the resends it took, may be NULL.
+ * @retval Length of the reply, 0 - no answer, -1 on a socket error, TLV_REFUSED - the UUT
+ *         does not know the message type: it answered with TLV_MSG_ERROR, or with a plain
+ *         TEST_ERR when its firmware predates TLV_MSG_ERROR.
+ */
+static ssize_t tlv_request(int sockfd, const struct sockaddr_in *uut_addr, const void *frame, uint16_t len,
+                           int reply_type, unsigned char *reply, size_t reply_size, unsigned *attempts)
+{
+    for (unsigned attempt = 0; attempt <= PIPELINE_DEFAULT_RETRIES; attempt++) {
+        if (sendto(sockfd, frame, len, 0, (const struct sockaddr *)uut_addr, sizeof(*uut_addr)) < 0) {
+            perror("sendto failed");
+            return -1;
+        }
+
+        double deadline = time_now() + PIPELINE_DEFAULT_TIMEOUT / 1000.0;
+        int wait_ms;
+        while ((wait_ms = (int)((deadline - time_now()) * 1000)) > 0) {
+            struct pollfd pfd = {.fd = sockfd, .events = POLLIN};
+            if (poll(&pfd, 1, wait_ms) <= 0) break;
+
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(sockfd, reply, reply_size, 0, (struct sockaddr *)&from, &from_len);
+            if (n < 0 || from.sin_addr.s_addr != uut_addr->sin_addr.s_addr || from.sin_port != uut_addr->sin_port) continue;
+
+            if (tlv_message_type(reply, (uint16_t)n) == reply_type) {
+                if (attempts != NULL) *attempts = attempt;
+                return n;
+            }
+            if (legacy_refusal(reply, n) || tlv_message_type(reply, (uint16_t)n) == TLV_MSG_ERROR) return TLV_REFUSED;
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief -C: Cancels a test, or every queued and running test (test_id 0), on one UUT and
+ * prints how many were cancelled. The cancel is resent until the UUT answers it.
+ * @param tests_port: Local port the tests were sent from, 0 - any port of this host.
+ * @retval 0 on success, -1 on a socket error, no answer or a UUT that cannot cancel.
+ */
+int cancel_tests(int sockfd, const struct sockaddr_in *uut_addr, uint32_t test_id, uint16_t tests_port)
+{
+    unsigned char frame[TLV_FRAME_MAX];
+    unsigned char reply[RESULT_FRAME_SIZE];
+    uint16_t len = tlv_encode_cancel(frame, sizeof(frame), TLV_MSG_CANCEL, test_id, tests_port, 0);
+    uint16_t count;
+    uint32_t reply_id;
+    unsigned attempts;
+
+    ssize_t n = tlv_request(sockfd, uut_addr, frame, len, TLV_MSG_CANCELLED, reply, sizeof(reply), &attempts);
+    if (n > 0 && tlv_decode_cancel(reply, (uint16_t)n, TLV_MSG_CANCELLED, &reply_id, NULL, &count) == 0) {
+        // After a lost answer the resent cancel finds nothing left to cancel
+        printf("%s:%u: %u tests cancelled%s\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port), count,
+               attempts > 0 ? " (resent)" : "");
+        return 0;
+    }
+    if (n == TLV_REFUSED) {
+        // Firmware without TLV_MSG_CANCEL refuses the frame
+        printf("%s:%u: the UUT cannot cancel tests\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port));
+    }
+    else if (n >= 0) {
+        printf("%s:%u: no answer to the cancel\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port));
+    }
+    return -1;
+}
+
+/*
+ * @brief -I: Prints the test queue statistics of one UUT.
+ * @retval 0 on success, -1 on a socket error, no answer or a UUT without a priority queue.
+ */
+int print_queue_stats(int sockfd, const struct sockaddr_in *uut_addr)
+{
+    unsigned char frame[TLV_HEADER_SIZE];
+    unsigned char reply[RESULT_FRAME_SIZE];
+    uint16_t len = tlv_encode_query(frame, sizeof(frame), TLV_MSG_STATS_QUERY);
+    tlv_queue_stats_t stats;
+
+    ssize_t n = tlv_request(sockfd, uut_addr, frame, len, TLV_MSG_STATS, reply, sizeof(reply), NULL);
+    if (n > 0 && tlv_decode_stats(reply, (uint16_t)n, &stats) == 0) {
+        printf("%s:%u: %u queued now (at most %u), %u queued in all, %u rejected, %u expired, %u preempted, "
+               "wait avg %u / max %u ms\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port),
+               stats.depth, stats.high_water, stats.queued, stats.rejected, stats.expired, stats.preempted,
+               stats.wait_avg_ms, stats.wait_max_ms);
+        if (stats.pool_high_water > 0) {
+            printf("%s:%u: command pool: at most %u descriptors in use, %u commands refused with none free, "
+                   "%u copied out of fragmented frames\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port),
+                   stats.pool_high_water, stats.pool_exhausted, stats.pool_copied);
+        }
+        return 0;
+    }
+    if (n == TLV_REFUSED) {
+        printf("%s:%u: the UUT keeps no queue statistics\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port));
+    }
+    else if (n >= 0) {
+        printf("%s:%u: no answer to the statistics query\n", inet_ntoa(uut_addr->sin_addr), ntohs(uut_addr->sin_port));
+    }
+    return -1;
+}
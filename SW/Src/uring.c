@@ -0,0 +1,251 @@
+/**
+  * @brief Minimal io_uring engine on the raw system calls
+  *
+  * Sends are queued as IORING_OP_SEND entries and published together with the wait for
+  * completions, so one io_uring_enter() both submits a whole window of commands and sleeps
+  * until a result (or the nearest deadline) arrives. Results are received by multishot
+  * recvmsg operations that keep filling the provided buffers without being re-armed.
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int uring_map_queues(uring_t *ring, const struct io_uring_params *params)
+{
+    ring->sq_map_length = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_map_length = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_length > ring->sq_map_length) ring->sq_map_length = ring->cq_map_length;
+        ring->cq_map_length = ring->sq_map_length;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        return -1;
+    }
+    if (params->features & IORING_FEAT_SINGLE_MMAP) ring->cq_map = ring->sq_map;
+    else {
+        ring->cq_map = mmap(NULL, ring->cq_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            return -1;
+        }
+    }
+
+    ring->sqes_length = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    unsigned char *sq = ring->sq_map;
+    unsigned char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params->sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params->sq_off.ring_mask);
+    ring->sq_entries = params->sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+    // Submission slot i always holds entry i
+    unsigned *array = (unsigned *)(sq + params->sq_off.array);
+    for (unsigned i = 0; i < params->sq_entries; i++) array[i] = i;
+    return 0;
+}
+
+// Registers URING_BUFFERS receive buffers as group URING_BUFFER_GROUP
+static int uring_register_buffers(uring_t *ring)
+{
+    struct io_uring_buf_reg reg;
+
+    ring->buf_ring_length = URING_BUFFERS * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED) {
+        ring->buf_ring = NULL;
+        return -1;
+    }
+    ring->buffers = malloc((size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+    if (ring->buffers == NULL) return -1;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -1;
+
+    ring->buf_tail = 0;
+    for (unsigned bid = 0; bid < URING_BUFFERS; bid++) uring_recycle(ring, bid);
+    return 0;
+}
+
+/*
+ * @brief Sets up a ring with `entries` submission entries and the receive buffers.
+ * @retval The ring, NULL when the kernel lacks io_uring (or the needed features) - the
+ * caller falls back to the plain socket calls.
+ */
+uring_t *uring_create(unsigned entries)
+{
+    struct io_uring_params params;
+    uring_t *ring = calloc(1, sizeof(uring_t));
+
+    if (ring == NULL) {
+        perror("Error: Could not allocate the io_uring");
+        return NULL;
+    }
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;    // Room for the results of a full window and the timeouts
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        perror("Warning: io_uring is not available");
+        free(ring);
+        return NULL;
+    }
+    if (!(params.features & IORING_FEAT_NODROP) || uring_map_queues(ring, &params) < 0 ||
+        uring_register_buffers(ring) < 0) {
+        perror("Warning: io_uring lacks the needed features");
+        uring_free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void uring_free(uring_t *ring)
+{
+    if (ring == NULL) return;
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_length);
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_length);
+    if (ring->sq_map != NULL) munmap(ring->sq_map, ring->sq_map_length);
+    if (ring->buf_ring != NULL) munmap(ring->buf_ring, ring->buf_ring_length);
+    if (ring->fd >= 0) close(ring->fd);     // Cancels whatever is still pending
+    free(ring->buffers);
+    free(ring);
+}
+
+/*
+ * @brief Next free submission entry, zeroed. Submits what is queued when the queue is full.
+ * @retval The entry, NULL if the queue stays full.
+ */
+struct io_uring_sqe *uring_sqe(uring_t *ring)
+{
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        if (uring_submit(ring) < 0 ||
+            ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+static int uring_enter(uring_t *ring, unsigned min_complete)
+{
+    unsigned to_submit = ring->sq_local_tail - *ring->sq_tail;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    ring->syscalls++;
+    return sys_io_uring_enter(ring->fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+}
+
+/*
+ * @brief Hands the prepared entries to the kernel without waiting.
+ * @retval 0 on success, -1 on failure (errno set).
+ */
+int uring_submit(uring_t *ring)
+{
+    if (ring->sq_local_tail == *ring->sq_tail) return 0;
+    return uring_enter(ring, 0) < 0 ? -1 : 0;
+}
+
+/*
+ * @brief Submits the prepared entries and waits up to timeout_ms (-1 - no limit) for a completion.
+ * The wait is an IORING_OP_TIMEOUT that also ends with the first other completion, submitted
+ * in the same call: no separate timer or poll syscall.
+ * @retval 0 on success, -1 on failure (errno set, EINTR included).
+ */
+int uring_wait(uring_t *ring, int timeout_ms)
+{
+    if (__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head || timeout_ms == 0) {
+        return uring_submit(ring);
+    }
+
+    if (timeout_ms > 0) {
+        struct io_uring_sqe *sqe = uring_sqe(ring);
+        if (sqe == NULL) return -1;
+        ring->timeout.tv_sec = timeout_ms / 1000;
+        ring->timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)&ring->timeout;
+        sqe->len = 1;
+        sqe->off = 1;                   // Or as soon as one other completion is posted
+        sqe->user_data = URING_TIMER;
+    }
+    return uring_enter(ring, 1) < 0 ? -1 : 0;
+}
+
+/*
+ * @brief The oldest unseen completion, NULL if there is none. Release it with uring_seen().
+ */
+struct io_uring_cqe *uring_peek(uring_t *ring)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_seen(uring_t *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+unsigned char *uring_buffer(uring_t *ring, unsigned bid)
+{
+    return ring->buffers + (size_t)bid * URING_BUFFER_SIZE;
+}
+
+// Gives a receive buffer back to the kernel
+void uring_recycle(uring_t *ring, unsigned bid)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUFFERS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)uring_buffer(ring, bid);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = (uint16_t)bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
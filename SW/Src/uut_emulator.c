@@ -0,0 +1,955 @@
+/**
+  * @brief Host side UUT emulator
+  *
+  * Speaks the UUT's wire format (test_command_t in, result_pro_t out) without a board and
+  * behaves like the firmware around it: udp_receive_callback() accepts full size and compact
+  * (TEST_COMMAND_SIZE) commands, answers resent test IDs from a result cache and rejects
+  * commands when the test queue is full; perform_tests() runs one test at a time per UUT, taking
+  * a configurable time per peripheral and failing at a configurable rate. COMMAND_BATCH_TAG
+  * frames are taken apart like on the board, and the results of their commands that complete
+  * in the same round share RESULT_BATCH_TAG frames. STREAM_PROGRESS tests report their
+  * iterations (spread evenly over the ITER_MS part) in PROGRESS_TAG frames like test_monitor.c.
+  * EXTENDED_RESULT tests are answered with a result_ext_t; an emulated failure is a data
+  * mismatch in the first byte of the last iteration. TLV frames (tlv.h) are understood like
+  * on the board: capability queries are answered, TLV commands are run like plain ones, and a
+  * cancel drops queued tests and stops the running one at the end of its current iteration.
+  * Like test_queue.c, the queue runs the highest TLV_PRIORITY first, answers commands whose
+  * TLV_DEADLINE passed with TEST_ERR, and a command of higher priority on another peripheral
+  * runs at the next iteration boundary of the running test, which then resumes. A soak
+  * (TLV_SOAK_ITERATIONS/TLV_SOAK_DURATION) runs its iterations back to back, ITER_MS each or
+  * EMULATOR_SOAK_ITER_MS when that is 0, fails that share of them, and ends with a
+  * TLV_MSG_SOAK_RESULT; a resend is answered with the plain result like on the board.
+  *
+  *   uut_emulator -p 5005 &
+  *   udp_server -a 127.0.0.1:5005 -s 0 -n 1000 -w 16 UART 1
+  *
+  * Several virtual UUTs (for the client's fleet mode) listen on consecutive ports, each with
+  * its own queue, executor and cache. Commands are received and answered EMULATOR_BATCH at a
+  * time (recvmmsg/sendmmsg), so the emulator stays out of the way of the client's own
+  * syscall measurements. Ctrl-C prints what every UUT saw.
+  *
+  * @param -p port: UDP port to listen on (default CLIENT_PORT), the first one with -n
+  * @param -n uuts: Number of virtual UUTs (default 1)
+  * @param -e NAME=MS[+ITER_MS]: Execution time of a peripheral's test: MS plus ITER_MS per
+  *           iteration (NAME is TIMER/UART/SPI/I2C/ADC or ALL, default 0 - instant).
+  *           The board paces iterations with osDelay(10), so ALL=0+10 is close to it.
+  * @param -f NAME=PERCENT: Share of a peripheral's tests that return TEST_FAIL
+  * @param -d percent: Share of commands lost on the way to the UUT
+  * @param -l percent: Share of results lost on the way back
+  * @param -q depth: Test queue length of every UUT (default EMULATOR_QUEUE_DEPTH)
+  * @param -S seed: Seed of the drop and failure decisions (default 1)
+  * @retval None
+  */
+#define _GNU_SOURCE             // sendmmsg(), recvmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "project_header.h"
+#include "tlv.h"
+#include "result_log.h"
+#include "cache_table.h"
+
+#define MAX_UUTS                1024
+#define EMULATOR_BATCH          64
+#define EMULATOR_QUEUE_DEPTH    16      // TEST_QUEUE_SIZE in test_queue.h
+#define EMULATOR_MAX_QUEUE      256
+#define EMULATOR_DATAGRAM_MAX   BATCH_FRAME_MAX     // a batch frame, more than a full test_command_t
+#define EMULATOR_SOAK_ITER_MS   0.1     // iteration time of a soak on a peripheral without ITER_MS
+
+#pragma pack(1)  // Disable padding
+typedef struct progress_frame_t {
+    progress_header_t header;
+    progress_record_t records[PROGRESS_RECORDS_MAX];
+} progress_frame_t;
+#pragma pack()  // Restore default packing
+
+// A command accepted into a UUT's queue
+typedef struct emu_command_t {
+    uint32_t test_id;
+    Peripheral peripheral;
+    uint8_t iterations;
+    struct sockaddr_in from;
+    int batched;                    // Came in a batch frame: the result may share a datagram
+    uint8_t priority;
+    double deadline;                // When it must have started by, 0 - none
+    double queued_at;
+    uint32_t soak_iterations;       // Soak limits, both 0 - a plain test
+    unsigned soak_ms;
+} emu_command_t;
+
+// A test set aside at an iteration boundary while a more urgent one runs
+typedef struct emu_suspended_t {
+    emu_command_t current;
+    double paused_at;
+    double remaining;               // Of its execution time
+    double started_at;
+    uint8_t progress_done;
+    int cancelled;
+    uint8_t cancel_passed;
+} emu_suspended_t;
+
+typedef struct virtual_uut_t {
+    int sockfd;
+
+    emu_command_t queue[EMULATOR_MAX_QUEUE];
+    unsigned head;
+    unsigned queued;
+
+    int running;
+    emu_command_t current;
+    double done_at;                 // When the running test completes
+    double started_at;
+    double progress_sent_at;        // STREAM_PROGRESS: when the last progress frame went out
+    uint8_t progress_done;          // Iterations reported so far
+    int cancelled;                  // 1 - the running test was cancelled, it ends at done_at
+    uint8_t cancel_passed;          // Its iterations that finished before it stopped
+    double preempt_at;              // Iteration boundary a queued test preempts the running one at, 0 - none
+    int suspended;                  // 1 - `paused` waits for the preempting test to end
+    emu_suspended_t paused;
+    double next_expiry;             // Earliest deadline in the queue, 0 - none
+
+    cache_table_t cache;            // Shared with result_cache.c
+
+    // Replies collected for one sendmmsg()
+    result_pro_t replies[EMULATOR_BATCH];
+    struct sockaddr_in reply_to[EMULATOR_BATCH];
+    int reply_batched[EMULATOR_BATCH];
+    unsigned pending_replies;
+
+    // Statistics
+    size_t received;
+    size_t executed;
+    size_t failed;
+    size_t duplicates;              // Resends answered from the cache or ignored while pending
+    size_t rejected;                // Malformed, or the queue was full
+    size_t cancelled_tests;         // Queued or running tests cancelled
+    size_t expired;                 // Answered with TEST_ERR when their deadline passed in the queue
+    size_t preempted;               // Tests run at an iteration boundary of a lower priority one
+    size_t queued_total;
+    size_t started;
+    double wait_sum;                // Seconds from arrival to start, of the started tests
+    double wait_max;
+    unsigned high_water;
+    size_t dropped;                 // Commands lost on the way in
+    size_t lost;                    // Results lost on the way out
+} virtual_uut_t;
+
+static double exec_base_ms[PERIPHERAL_COUNT];
+static double exec_iter_ms[PERIPHERAL_COUNT];
+static double fail_rate[PERIPHERAL_COUNT];
+static double drop_rate;
+static double loss_rate;
+static unsigned queue_depth = EMULATOR_QUEUE_DEPTH;
+static unsigned short rng_state[3] = {0x330e, 1, 0};
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static double now_sec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+// 1 with the given percent probability
+static int chance(double percent)
+{
+    return percent > 0 && erand48(rng_state) * 100.0 < percent;
+}
+
+/*
+ * @brief Parses NAME=VALUE, NAME being a peripheral or ALL.
+ * @retval Bit i set for every peripheral slot i the option applies to, 0 on a bad name.
+ */
+static unsigned parse_peripheral_option(const char *text, const char **value)
+{
+    const char *eq = strchr(text, '=');
+    if (eq == NULL) return 0;
+
+    *value = eq + 1;
+    if ((size_t)(eq - text) == 3 && strncmp(text, "ALL", 3) == 0) return (1u << PERIPHERAL_COUNT) - 1;
+    for (int slot = 0; slot < PERIPHERAL_COUNT; slot++) {
+        const char *name = peripheral_name(peripheral_at(slot));
+        if (strlen(name) == (size_t)(eq - text) && strncmp(text, name, eq - text) == 0) {
+            return 1u << slot;
+        }
+    }
+    return 0;
+}
+
+static int open_uut_socket(long port)
+{
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in uut_addr;
+    memset(&uut_addr, 0, sizeof(uut_addr));
+    uut_addr.sin_family = AF_INET;
+    uut_addr.sin_addr.s_addr = INADDR_ANY;
+    uut_addr.sin_port = htons(port);
+
+    if (bind(sockfd, (const struct sockaddr *)&uut_addr, sizeof(uut_addr)) < 0) {
+        perror("Bind failed");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static int same_address(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// result_agg.c: consecutive batched results for one controller share RESULT_BATCH_TAG frames
+static void flush_replies(virtual_uut_t *uut)
+{
+    static unsigned char frames[EMULATOR_BATCH][BATCH_HEADER_SIZE + RESULT_BATCH_MAX * sizeof(result_pro_t)];
+    struct mmsghdr msgs[EMULATOR_BATCH];
+    struct iovec iovs[EMULATOR_BATCH];
+    unsigned n = 0;
+
+    for (unsigned k = 0; k < uut->pending_replies; n++) {
+        batch_header_t header = {.tag = RESULT_BATCH_TAG, .count = 1};
+        while (uut->reply_batched[k] && k + header.count < uut->pending_replies && header.count < RESULT_BATCH_MAX &&
+               uut->reply_batched[k + header.count] && same_address(&uut->reply_to[k], &uut->reply_to[k + header.count])) {
+            header.count++;
+        }
+
+        if (header.count == 1) {
+            iovs[n].iov_base = &uut->replies[k];
+            iovs[n].iov_len = sizeof(result_pro_t);
+        }
+        else {
+            memcpy(frames[n], &header, BATCH_HEADER_SIZE);
+            memcpy(frames[n] + BATCH_HEADER_SIZE, &uut->replies[k], header.count * sizeof(result_pro_t));
+            iovs[n].iov_base = frames[n];
+            iovs[n].iov_len = BATCH_HEADER_SIZE + header.count * sizeof(result_pro_t);
+        }
+        memset(&msgs[n].msg_hdr, 0, sizeof(struct msghdr));
+        msgs[n].msg_hdr.msg_name = &uut->reply_to[k];
+        msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msgs[n].msg_hdr.msg_iov = &iovs[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        k += header.count;
+    }
+    if (n > 0) sendmmsg(uut->sockfd, msgs, n, 0);
+    uut->pending_replies = 0;
+}
+
+// send_response(): queued for the next sendmmsg(), unless the network loses it
+static void reply(virtual_uut_t *uut, uint32_t test_id, Result result, const struct sockaddr_in *to, int batched)
+{
+    if (chance(loss_rate)) {
+        uut->lost++;
+        return;
+    }
+    uut->replies[uut->pending_replies].test_id = test_id;
+    uut->replies[uut->pending_replies].test_result = result;
+    uut->reply_to[uut->pending_replies] = *to;
+    uut->reply_batched[uut->pending_replies] = batched;
+    if (++uut->pending_replies == EMULATOR_BATCH) flush_replies(uut);
+}
+
+#define NOT_CANCELLED   (-1)
+#define EXPIRED         (-2)        // Never ran, its deadline passed while queued
+
+// perform_tests() of an EXTENDED_RESULT command: sent at once, unless the network loses it
+// cancelled_after: iterations passed before a cancel stopped the test, NOT_CANCELLED or EXPIRED
+static void reply_extended(virtual_uut_t *uut, const emu_command_t *cmd, Result result, int cancelled_after)
+{
+    int slot = peripheral_slot(cmd->peripheral);
+    result_ext_t ext;
+
+    if (chance(loss_rate)) {
+        uut->lost++;
+        return;
+    }
+    memset(&ext, 0, sizeof(ext));
+    ext.tag = RESULT_EXT_TAG;
+    ext.test_id = cmd->test_id;
+    ext.test_result = result;
+    if (cancelled_after >= 0) {
+        ext.failure = FAILURE_CANCELLED;
+        ext.iterations_passed = (uint8_t)cancelled_after;
+        if (cancelled_after > 0) ext.min_us = ext.avg_us = ext.max_us = (uint32_t)(exec_iter_ms[slot] * 1000.0);
+    }
+    else if (cancelled_after == EXPIRED) {
+        ext.failure = FAILURE_EXPIRED;
+    }
+    else if (result == TEST_ERR) {
+        ext.failure = FAILURE_INVALID;
+    }
+    else {
+        ext.iterations_passed = (result == TEST_PASS) ? cmd->iterations : cmd->iterations - 1;
+        ext.failure = (result == TEST_PASS) ? FAILURE_NONE : FAILURE_DATA;
+        ext.expected = (result == TEST_PASS) ? 0 : 0x55;
+        ext.actual = (result == TEST_PASS) ? 0 : 0xAA;
+        ext.min_us = ext.avg_us = ext.max_us = (uint32_t)(exec_iter_ms[slot] * 1000.0);
+    }
+    sendto(uut->sockfd, &ext, sizeof(ext), 0, (const struct sockaddr *)&cmd->from, sizeof(cmd->from));
+}
+
+static int is_soak(const emu_command_t *cmd)
+{
+    return cmd->soak_iterations > 0 || cmd->soak_ms > 0;
+}
+
+// Millis a soak iteration of the slot's peripheral takes
+static double soak_iter_ms(int slot)
+{
+    return exec_iter_ms[slot] > 0 ? exec_iter_ms[slot] : EMULATOR_SOAK_ITER_MS;
+}
+
+// Iterations a soak runs: its count, or as many as fit its duration, whichever is fewer
+static uint32_t soak_length(const emu_command_t *cmd, int slot)
+{
+    double fit = cmd->soak_ms > 0 ? cmd->soak_ms / soak_iter_ms(slot) + 0.999 : UINT32_MAX;
+    if (fit < 1) fit = 1;
+    if (cmd->soak_iterations > 0 && cmd->soak_iterations < fit) return cmd->soak_iterations;
+    return fit < UINT32_MAX ? (uint32_t)fit : UINT32_MAX;
+}
+
+static double exec_time(const emu_command_t *cmd)
+{
+    int slot = peripheral_slot(cmd->peripheral);
+    if (slot < 0) return 0;
+    if (is_soak(cmd)) return (exec_base_ms[slot] + soak_iter_ms(slot) * soak_length(cmd, slot)) / 1000.0;
+    return (exec_base_ms[slot] + exec_iter_ms[slot] * cmd->iterations) / 1000.0;
+}
+
+// test_queue.c order: 1 - a runs before b (b queued earlier)
+static int runs_before(const emu_command_t *a, const emu_command_t *b)
+{
+    if (a->priority != b->priority) return a->priority > b->priority;
+    if (a->deadline != b->deadline) return b->deadline == 0 || (a->deadline != 0 && a->deadline < b->deadline);
+    return 0;
+}
+
+static emu_command_t *queued_at(virtual_uut_t *uut, unsigned k)
+{
+    return &uut->queue[(uut->head + k) % EMULATOR_MAX_QUEUE];
+}
+
+// Position in the queue of the command to run next, -1 when empty
+static int best_queued(virtual_uut_t *uut)
+{
+    int best = -1;
+    for (unsigned k = 0; k < uut->queued; k++) {
+        if (best < 0 || runs_before(queued_at(uut, k), queued_at(uut, best))) best = k;
+    }
+    return best;
+}
+
+// Takes the command at position k out of the queue, the later ones keep their order
+static emu_command_t take_queued(virtual_uut_t *uut, unsigned k)
+{
+    emu_command_t cmd = *queued_at(uut, k);
+    for (; k + 1 < uut->queued; k++) *queued_at(uut, k) = *queued_at(uut, k + 1);
+    uut->queued--;
+    return cmd;
+}
+
+// test_queue_pop_above(): a higher priority on another peripheral
+static int preempts(const emu_command_t *next, const emu_command_t *running)
+{
+    return next->priority > running->priority &&
+           (next->peripheral & PERIPHERAL_MASK) != (running->peripheral & PERIPHERAL_MASK);
+}
+
+static void finish_test(virtual_uut_t *uut, const emu_command_t *cmd, Result result, int cancelled_after);
+
+// answer_expired(): the queued commands whose deadline passed by `now` get TEST_ERR without running
+static void expire_queued(virtual_uut_t *uut, double now)
+{
+    unsigned k = 0;
+
+    uut->next_expiry = 0;
+    while (k < uut->queued) {
+        const emu_command_t *cmd = queued_at(uut, k);
+        if (cmd->deadline == 0 || cmd->deadline >= now) {
+            if (cmd->deadline != 0 && (uut->next_expiry == 0 || cmd->deadline < uut->next_expiry)) {
+                uut->next_expiry = cmd->deadline;
+            }
+            k++;
+            continue;
+        }
+        emu_command_t expired = take_queued(uut, k);
+        finish_test(uut, &expired, TEST_ERR, EXPIRED);
+        uut->expired++;
+    }
+}
+
+// Runs the queued command at position k from `start`
+static void start_queued(virtual_uut_t *uut, unsigned k, double start)
+{
+    uut->current = take_queued(uut, k);
+    uut->running = 1;
+    uut->cancelled = 0;
+    uut->preempt_at = 0;
+    uut->done_at = start + exec_time(&uut->current);
+    uut->started_at = start;
+    uut->progress_sent_at = start;
+    uut->progress_done = 0;
+    uut->started++;
+    uut->wait_sum += start - uut->current.queued_at;
+    if (start - uut->current.queued_at > uut->wait_max) uut->wait_max = start - uut->current.queued_at;
+}
+
+// The next command off the queue, or the preempted test when nothing more urgent is queued,
+// its test starting at `start`
+static void start_next(virtual_uut_t *uut, double start)
+{
+    expire_queued(uut, start);
+    int k = best_queued(uut);
+
+    if (uut->suspended && (k < 0 || !preempts(queued_at(uut, k), &uut->paused.current))) {
+        // Resumes where it stopped, its times shifted by the pause
+        uut->current = uut->paused.current;
+        uut->cancelled = uut->paused.cancelled;
+        uut->cancel_passed = uut->paused.cancel_passed;
+        uut->progress_done = uut->paused.progress_done;
+        uut->started_at = uut->paused.started_at + (start - uut->paused.paused_at);
+        uut->done_at = start + uut->paused.remaining;
+        uut->progress_sent_at = start;
+        uut->preempt_at = 0;
+        uut->suspended = 0;
+        uut->running = 1;
+        return;
+    }
+    if (k < 0) {
+        uut->running = 0;
+        return;
+    }
+    if (uut->suspended) uut->preempted++;
+    start_queued(uut, k, start);
+}
+
+// The first iteration boundary of the running test after `now`, 0 when none is left
+static double next_boundary(const virtual_uut_t *uut, double now)
+{
+    int slot = peripheral_slot(uut->current.peripheral);
+    if (slot < 0 || exec_iter_ms[slot] <= 0) return 0;
+
+    double first = uut->started_at + exec_base_ms[slot] / 1000.0, iter = exec_iter_ms[slot] / 1000.0;
+    double at = (now <= first) ? first : first + iter * (int)((now - first) / iter + 1);
+    return at < uut->done_at ? at : 0;
+}
+
+// test_monitor_checkpoint(): plans the preemption of the running test by the best queued
+// command, one level deep like on the board
+static void plan_preemption(virtual_uut_t *uut, double now)
+{
+    int k = best_queued(uut);
+    if (!uut->running || uut->suspended || uut->cancelled || k < 0 || !preempts(queued_at(uut, k), &uut->current)) return;
+    uut->preempt_at = next_boundary(uut, now);
+}
+
+// Sets the running test aside at `at` for the command that preempts it
+static void suspend_running(virtual_uut_t *uut, double at)
+{
+    uut->paused.current = uut->current;
+    uut->paused.paused_at = at;
+    uut->paused.remaining = uut->done_at - at;
+    uut->paused.started_at = uut->started_at;
+    uut->paused.progress_done = uut->progress_done;
+    uut->paused.cancelled = uut->cancelled;
+    uut->paused.cancel_passed = uut->cancel_passed;
+    uut->suspended = 1;
+    start_next(uut, at);
+}
+
+static double progress_next(const virtual_uut_t *uut)
+{
+    return uut->progress_sent_at + PROGRESS_INTERVAL_MS / 1000.0;
+}
+
+// test_monitor.c: the iterations of a STREAM_PROGRESS test finished by `now`, a frame every
+// PROGRESS_INTERVAL_MS and the rest ahead of the result. A failure is put on the last iteration.
+static void report_progress(virtual_uut_t *uut, double now, int finished, Result result)
+{
+    const emu_command_t *cmd = &uut->current;
+    int slot = peripheral_slot(cmd->peripheral);
+    progress_frame_t frame;
+
+    if (!(cmd->peripheral & STREAM_PROGRESS) || slot < 0 || (!finished && now < progress_next(uut))) return;
+
+    frame.header.batch.tag = PROGRESS_TAG;
+    frame.header.batch.count = 0;
+    frame.header.test_id = cmd->test_id;
+    frame.header.iterations = cmd->iterations;
+    while (uut->progress_done < cmd->iterations) {
+        uint8_t k = uut->progress_done;
+        double at = (k + 1 == cmd->iterations) ? uut->done_at :
+                    uut->started_at + (exec_base_ms[slot] + exec_iter_ms[slot] * (k + 1)) / 1000.0;
+        if (at > now) break;
+
+        progress_record_t *record = &frame.records[frame.header.batch.count++];
+        record->iteration = k;
+        record->status = (k + 1 == cmd->iterations && result != TEST_PASS) ? PROGRESS_FAILED : PROGRESS_PASSED;
+        record->elapsed_us = (uint32_t)((at - uut->started_at) * 1e6);
+        uut->progress_done++;
+
+        if (frame.header.batch.count == PROGRESS_RECORDS_MAX || uut->progress_done == cmd->iterations) break;
+    }
+    if (frame.header.batch.count > 0) {
+        sendto(uut->sockfd, &frame, sizeof(progress_header_t) + frame.header.batch.count * sizeof(progress_record_t),
+               0, (const struct sockaddr *)&cmd->from, sizeof(cmd->from));
+    }
+    uut->progress_sent_at = now;
+    // More than a frame's worth finished: send the rest as well
+    if (frame.header.batch.count == PROGRESS_RECORDS_MAX) report_progress(uut, now, finished, result);
+}
+
+// Caches the result of a test and answers its controller
+static void finish_test(virtual_uut_t *uut, const emu_command_t *cmd, Result result, int cancelled_after)
+{
+    result_pro_t done = {cmd->test_id, result};
+
+    cache_table_complete(&uut->cache, done, cmd->from.sin_addr.s_addr, cmd->from.sin_port);
+    if (cmd->peripheral & EXTENDED_RESULT) reply_extended(uut, cmd, result, cancelled_after);
+    else reply(uut, cmd->test_id, result, &cmd->from, cmd->batched);
+}
+
+// run_soak(): caches the plain result and answers with the soak's counts; a cancelled soak
+// counts the iterations finished by done_at
+static void finish_soak(virtual_uut_t *uut, const emu_command_t *cmd, Result result)
+{
+    int slot = peripheral_slot(cmd->peripheral);
+    double elapsed = uut->done_at - uut->started_at;
+    tlv_soak_result_t soak = {.test_id = cmd->test_id, .result = result, .elapsed_ms = (uint32_t)(elapsed * 1000.0)};
+    uint32_t done = 0;
+    unsigned char frame[TLV_FRAME_MAX];
+
+    if (slot >= 0) {
+        done = soak_length(cmd, slot);
+        double ran = (elapsed * 1000.0 - exec_base_ms[slot]) / soak_iter_ms(slot);
+        if (uut->cancelled) done = ran <= 0 ? 0 : (ran < done ? (uint32_t)ran : done);
+        soak.failed = (uint32_t)(done * fail_rate[slot] / 100.0 + 0.5);
+        soak.passed = done - soak.failed;
+    }
+    if (soak.result == TEST_PASS && soak.failed > 0) soak.result = TEST_FAIL;
+
+    result_pro_t plain = {soak.test_id, soak.result};
+    cache_table_complete(&uut->cache, plain, cmd->from.sin_addr.s_addr, cmd->from.sin_port);
+    if (soak.result == TEST_FAIL) uut->failed++;
+    uint16_t frame_len = tlv_encode_soak_result(frame, sizeof(frame), &soak);
+    if (chance(loss_rate)) uut->lost++;
+    else sendto(uut->sockfd, frame, frame_len, 0, (const struct sockaddr *)&cmd->from, sizeof(cmd->from));
+}
+
+// perform_tests(): completes every test due by `now`, back to back
+static void advance(virtual_uut_t *uut, double now)
+{
+    if (uut->next_expiry != 0 && uut->next_expiry < now) expire_queued(uut, now);
+    for (;;) {
+        if (uut->running && uut->preempt_at != 0 && uut->preempt_at <= now) {
+            double at = uut->preempt_at;
+            uut->preempt_at = 0;
+            suspend_running(uut, at);
+            continue;
+        }
+        if (!uut->running || uut->done_at > now) break;
+        const emu_command_t *cmd = &uut->current;
+        int slot = peripheral_slot(cmd->peripheral);
+        Result result = TEST_PASS;
+
+        if (slot < 0 || (!is_soak(cmd) && cmd->iterations < 1) || cmd->test_id == 0 || uut->cancelled) result = TEST_ERR;
+        else if (is_soak(cmd)) result = TEST_PASS;     // finish_soak() decides from the failed iterations
+        else if (chance(fail_rate[slot])) result = TEST_FAIL;
+
+        uut->executed++;
+        if (is_soak(cmd)) {
+            finish_soak(uut, cmd, result);
+            start_next(uut, uut->done_at);
+            continue;
+        }
+        if (result == TEST_FAIL) uut->failed++;
+        report_progress(uut, uut->done_at, 1, result);
+        finish_test(uut, cmd, result, uut->cancelled ? uut->cancel_passed : NOT_CANCELLED);
+        start_next(uut, uut->done_at);
+    }
+    if (uut->running) report_progress(uut, now, 0, TEST_PASS);
+}
+
+// accept_command(): one command at the start of `data`, returns its length or 0 when malformed
+// sched: priority and deadline of a TLV command, NULL - the defaults of a plain one
+static size_t receive_command(virtual_uut_t *uut, const unsigned char *data, size_t length,
+                              const struct sockaddr_in *from, int batched, const tlv_sched_t *sched, double now)
+{
+    test_command_t cmd;
+    const test_command_t *command = &cmd;
+
+    memcpy(&cmd, data, length < sizeof(cmd) ? length : sizeof(cmd));
+    if (length < TEST_COMMAND_HEADER_SIZE || length < TEST_COMMAND_SIZE(command)) {
+        uut->rejected++;
+        reply(uut, 0, TEST_ERR, from, 0);
+        return 0;
+    }
+
+    if (command->test_id != 0) {
+        result_pro_t cached;
+        CacheState state = cache_table_check(&uut->cache, command->test_id, from->sin_addr.s_addr,
+                                            from->sin_port, &cached);
+        if (state != CACHE_MISS) {
+            uut->duplicates++;
+            if (state == CACHE_DONE) reply(uut, command->test_id, cached.test_result, from, 0);
+            return TEST_COMMAND_SIZE(command);
+        }
+    }
+
+    if (uut->queued == queue_depth) {
+        uut->rejected++;
+        reply(uut, command->test_id, TEST_ERR, from, 0);
+        return TEST_COMMAND_SIZE(command);
+    }
+    if (command->test_id != 0) cache_table_pending(&uut->cache, command->test_id, from->sin_addr.s_addr, from->sin_port);
+
+    emu_command_t *slot = &uut->queue[(uut->head + uut->queued) % EMULATOR_MAX_QUEUE];
+    slot->test_id = command->test_id;
+    slot->peripheral = command->peripheral;
+    slot->iterations = command->iterations;
+    slot->from = *from;
+    slot->batched = batched;
+    slot->priority = sched ? sched->priority : PRIORITY_DEFAULT;
+    slot->deadline = (sched && sched->deadline_ms > 0) ? now + sched->deadline_ms / 1000.0 : 0;
+    slot->soak_iterations = sched ? sched->soak_iterations : 0;
+    slot->soak_ms = sched ? sched->soak_ms : 0;
+    if (is_soak(slot)) slot->peripheral &= ~STREAM_PROGRESS;
+    slot->queued_at = now;
+    if (slot->deadline != 0 && (uut->next_expiry == 0 || slot->deadline < uut->next_expiry)) uut->next_expiry = slot->deadline;
+    uut->queued++;
+    uut->queued_total++;
+    if (uut->queued > uut->high_water) uut->high_water = uut->queued;
+    if (!uut->running) start_next(uut, now);
+    else plan_preemption(uut, now);
+    return TEST_COMMAND_SIZE(command);
+}
+
+// cmd_pool_cancel(): a test of the controller at `addr` sent from `port` (host order, 0 - any)
+static int sent_by(const emu_command_t *cmd, in_addr_t addr, uint16_t port)
+{
+    return cmd->from.sin_addr.s_addr == addr && (port == 0 || ntohs(cmd->from.sin_port) == port);
+}
+
+// accept_cancel(): the matching queued tests of the controller are answered at once, a matching
+// running test stops at the end of its current iteration. Returns the number of tests cancelled.
+static uint16_t cancel_tests(virtual_uut_t *uut, uint32_t test_id, in_addr_t addr, uint16_t port, double now)
+{
+    uint16_t count = 0;
+    unsigned kept = 0;
+
+    for (unsigned k = 0; k < uut->queued; k++) {
+        emu_command_t cmd = uut->queue[(uut->head + k) % EMULATOR_MAX_QUEUE];
+        if ((test_id != 0 && cmd.test_id != test_id) || !sent_by(&cmd, addr, port)) {
+            uut->queue[(uut->head + kept++) % EMULATOR_MAX_QUEUE] = cmd;
+            continue;
+        }
+        finish_test(uut, &cmd, TEST_ERR, 0);
+        count++;
+    }
+    uut->queued = kept;
+
+    // A preempted test ends with TEST_ERR as soon as it resumes
+    if (uut->suspended && !uut->paused.cancelled && (test_id == 0 || uut->paused.current.test_id == test_id) &&
+        sent_by(&uut->paused.current, addr, port)) {
+        int slot = peripheral_slot(uut->paused.current.peripheral);
+        double iter = (slot < 0) ? 0 : exec_iter_ms[slot] / 1000.0;
+        count++;
+        uut->paused.cancelled = 1;
+        uut->paused.cancel_passed = (uint8_t)(uut->paused.current.iterations - (iter > 0 ? uut->paused.remaining / iter + 0.5 : 0));
+        uut->paused.remaining = 0;
+    }
+
+    if (uut->running && !uut->cancelled && (test_id == 0 || uut->current.test_id == test_id) &&
+        sent_by(&uut->current, addr, port)) {
+        int slot = peripheral_slot(uut->current.peripheral);
+        double base = (slot < 0) ? 0 : exec_base_ms[slot] / 1000.0;
+        double iter = (slot < 0) ? 0 : exec_iter_ms[slot] / 1000.0;
+        // Iterations finished by now plus the one under way
+        double passed = (iter > 0 && now > uut->started_at + base) ? (now - uut->started_at - base) / iter + 1 : 1;
+
+        count++;
+        if (is_soak(&uut->current)) {
+            // A soak stops after the run under way, which the emulator takes as now
+            uut->cancelled = 1;
+            if (now < uut->done_at) uut->done_at = now;
+        }
+        else if (iter > 0 && passed < uut->current.iterations) {
+            uut->cancelled = 1;
+            uut->cancel_passed = (uint8_t)passed;
+            uut->done_at = uut->started_at + base + iter * uut->cancel_passed;
+        }
+    }
+    uut->cancelled_tests += count;
+    return count;
+}
+
+// accept_tlv(): a capability or statistics query is answered at once, a command is accepted
+// like a plain one at its priority
+static void receive_tlv(virtual_uut_t *uut, const unsigned char *data, size_t length,
+                        const struct sockaddr_in *from, double now)
+{
+    uint16_t size = length < TLV_FRAME_MAX ? length : TLV_FRAME_MAX;
+    unsigned char frame[TLV_FRAME_MAX];
+    test_command_t cmd;
+    tlv_sched_t sched;
+    int type = tlv_message_type(data, size);
+    uint8_t code = TLV_ERR_MALFORMED;
+
+    switch (type) {
+    case TLV_MSG_CAPS_QUERY: {
+        tlv_caps_t caps = {
+            .version = PROTOCOL_VERSION,
+            .peripherals = TIMER | UART | SPI | I2C | ADC_P,
+            .max_pattern = MAX_BIT_PATTERN_LENGTH - 1,
+            .max_batch = COMMAND_BATCH_MAX,
+            .result_batch = RESULT_BATCH_MAX,
+            .features = FEATURE_COMPACT | FEATURE_BATCH_FRAMES | FEATURE_PROGRESS | FEATURE_EXTENDED_RESULT |
+                        FEATURE_TLV_COMMAND | FEATURE_CANCEL | FEATURE_PRIORITY | FEATURE_SOAK,
+            .build_id = "uut_emulator",
+        };
+        uint16_t frame_len = tlv_encode_caps(frame, sizeof(frame), &caps);
+        if (chance(loss_rate)) uut->lost++;
+        else sendto(uut->sockfd, frame, frame_len, 0, (const struct sockaddr *)from, sizeof(*from));
+        return;
+    }
+    case TLV_MSG_CANCEL: {
+        uint32_t test_id;
+        uint16_t tests_port = ntohs(from->sin_port);
+        if (tlv_decode_cancel(data, size, TLV_MSG_CANCEL, &test_id, &tests_port, NULL) < 0) break;
+        uint16_t count = cancel_tests(uut, test_id, from->sin_addr.s_addr, tests_port, now);
+        uint16_t frame_len = tlv_encode_cancel(frame, sizeof(frame), TLV_MSG_CANCELLED, test_id, 0, count);
+        if (chance(loss_rate)) uut->lost++;
+        else sendto(uut->sockfd, frame, frame_len, 0, (const struct sockaddr *)from, sizeof(*from));
+        return;
+    }
+    case TLV_MSG_STATS_QUERY: {
+        tlv_queue_stats_t stats = {
+            .depth = uut->queued,
+            .high_water = uut->high_water,
+            .queued = uut->queued_total,
+            .rejected = uut->rejected,
+            .expired = uut->expired,
+            .preempted = uut->preempted,
+            .wait_avg_ms = uut->started ? (uint32_t)(uut->wait_sum / uut->started * 1000.0) : 0,
+            .wait_max_ms = (uint32_t)(uut->wait_max * 1000.0),
+        };
+        uint16_t frame_len = tlv_encode_stats(frame, sizeof(frame), &stats);
+        if (chance(loss_rate)) uut->lost++;
+        else sendto(uut->sockfd, frame, frame_len, 0, (const struct sockaddr *)from, sizeof(*from));
+        return;
+    }
+    case TLV_MSG_COMMAND:
+        if (tlv_decode_command(data, size, &cmd, &sched) == 0) {
+            receive_command(uut, (const unsigned char *)&cmd, sizeof(cmd), from, 0, &sched, now);
+            return;
+        }
+        break;
+    default:
+        if (type >= 0) code = TLV_ERR_UNSUPPORTED;
+        break;
+    }
+    // A TLV_MSG_ERROR like accept_tlv(), not a result a newer host would take for test 0
+    uut->rejected++;
+    uint16_t frame_len = tlv_encode_error(frame, sizeof(frame), code, type < 0 ? 0 : (uint8_t)type);
+    if (chance(loss_rate)) uut->lost++;
+    else sendto(uut->sockfd, frame, frame_len, 0, (const struct sockaddr *)from, sizeof(*from));
+}
+
+// udp_receive_callback(): one received datagram, a command, a COMMAND_BATCH_TAG frame of them or a TLV frame
+static void receive_datagram(virtual_uut_t *uut, const unsigned char *data, size_t length,
+                             const struct sockaddr_in *from, double now)
+{
+    batch_header_t header = {0};
+
+    uut->received++;
+    if (chance(drop_rate)) {
+        uut->dropped++;
+        return;
+    }
+
+    if (length >= BATCH_HEADER_SIZE) memcpy(&header, data, BATCH_HEADER_SIZE);
+    if (header.tag == TLV_TAG) {
+        receive_tlv(uut, data, length, from, now);
+        return;
+    }
+    if (header.tag != COMMAND_BATCH_TAG) {
+        receive_command(uut, data, length, from, 0, NULL, now);
+        return;
+    }
+
+    size_t offset = BATCH_HEADER_SIZE;
+    for (uint8_t k = 0; k < header.count; k++) {
+        size_t cmd_len = receive_command(uut, data + offset, length - offset, from, 1, NULL, now);
+        if (cmd_len == 0) break;    // Truncated: the rest is resent by the client
+        offset += cmd_len;
+    }
+}
+
+// Takes in every command waiting on one virtual UUT's socket
+static void serve_uut(virtual_uut_t *uut, double now)
+{
+    static unsigned char datagrams[EMULATOR_BATCH][EMULATOR_DATAGRAM_MAX];
+    static struct sockaddr_in from[EMULATOR_BATCH];
+    static struct iovec iovs[EMULATOR_BATCH];
+    static struct mmsghdr msgs[EMULATOR_BATCH];
+
+    for (;;) {
+        for (int k = 0; k < EMULATOR_BATCH; k++) {
+            iovs[k].iov_base = datagrams[k];
+            iovs[k].iov_len = EMULATOR_DATAGRAM_MAX;
+            memset(&msgs[k].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[k].msg_hdr.msg_name = &from[k];
+            msgs[k].msg_hdr.msg_namelen = sizeof(from[k]);
+            msgs[k].msg_hdr.msg_iov = &iovs[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n = recvmmsg(uut->sockfd, msgs, EMULATOR_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("Receive failed");
+            return;
+        }
+        for (int k = 0; k < n; k++) {
+            receive_datagram(uut, datagrams[k], msgs[k].msg_len, &from[k], now);
+            // Instant tests complete before the next command is looked at, as on the board
+            advance(uut, now);
+        }
+        if (n < EMULATOR_BATCH) return;
+    }
+}
+
+static void print_stats(const virtual_uut_t *uuts, long count, long port)
+{
+    printf("\n%-6s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "Port", "Received", "Executed", "Failed", "Resends",
+           "Rejected", "Cancelled", "Expired", "Preempted", "Dropped", "Lost");
+    for (long i = 0; i < count; i++) {
+        const virtual_uut_t *uut = &uuts[i];
+        printf("%-6ld %9zu %9zu %9zu %9zu %9zu %9zu %9zu %9zu %9zu %9zu\n", port + i, uut->received, uut->executed,
+               uut->failed, uut->duplicates, uut->rejected, uut->cancelled_tests, uut->expired, uut->preempted,
+               uut->dropped, uut->lost);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long port = CLIENT_PORT;
+    long uuts = 1;
+    long depth = EMULATOR_QUEUE_DEPTH;
+    const char *value;
+    unsigned slots;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:e:f:d:l:q:S:")) != -1) {
+        switch (opt) {
+        case 'p': port = atol(optarg); break;
+        case 'n': uuts = atol(optarg); break;
+        case 'q': depth = atol(optarg); break;
+        case 'd': drop_rate = atof(optarg); break;
+        case 'l': loss_rate = atof(optarg); break;
+        case 'S':
+            rng_state[1] = (unsigned short)atol(optarg);
+            rng_state[2] = (unsigned short)(atol(optarg) >> 16);
+            break;
+        case 'e':
+        case 'f':
+            slots = parse_peripheral_option(optarg, &value);
+            if (slots == 0) {
+                printf("Invalid peripheral option: %s\n", optarg);
+                return 1;
+            }
+            for (int slot = 0; slot < PERIPHERAL_COUNT; slot++) {
+                if (!(slots & (1u << slot))) continue;
+                if (opt == 'f') {
+                    fail_rate[slot] = atof(value);
+                }
+                else {
+                    const char *plus = strchr(value, '+');
+                    exec_base_ms[slot] = atof(value);
+                    exec_iter_ms[slot] = plus ? atof(plus + 1) : 0;
+                }
+            }
+            break;
+        default:
+            printf("Usage: %s [-p port] [-n uuts] [-e NAME=MS[+ITER_MS]] [-f NAME=PERCENT] [-d percent] [-l percent] [-q depth] [-S seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (port < 1 || uuts < 1 || uuts > MAX_UUTS || port + uuts - 1 > 65535) {
+        printf("Invalid port or number of UUTs\n");
+        return 1;
+    }
+    if (depth < 1 || depth > EMULATOR_MAX_QUEUE) {
+        printf("Invalid queue depth (1-%d)\n", EMULATOR_MAX_QUEUE);
+        return 1;
+    }
+    queue_depth = depth;
+
+    struct pollfd *fds = calloc(uuts, sizeof(struct pollfd));
+    virtual_uut_t *uut = calloc(uuts, sizeof(virtual_uut_t));
+    if (fds == NULL || uut == NULL) {
+        perror("Error: Could not allocate the UUTs");
+        return 1;
+    }
+    for (long i = 0; i < uuts; i++) {
+        uut[i].sockfd = fds[i].fd = open_uut_socket(port + i);
+        if (fds[i].fd < 0) return 1;
+        fds[i].events = POLLIN;
+    }
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    printf("UUT emulator: %ld UUT(s) listening on ports %ld-%ld\n", uuts, port, port + uuts - 1);
+
+    while (!stop) {
+        // Sleep until a command arrives, the earliest running test completes, reports progress or
+        // is preempted, or a queued deadline passes
+        double now = now_sec(), nearest = -1;
+        for (long i = 0; i < uuts; i++) {
+            if (uut[i].running && (nearest < 0 || uut[i].done_at < nearest)) nearest = uut[i].done_at;
+            if (uut[i].running && uut[i].preempt_at != 0 && (nearest < 0 || uut[i].preempt_at < nearest)) nearest = uut[i].preempt_at;
+            if (uut[i].next_expiry != 0 && (nearest < 0 || uut[i].next_expiry < nearest)) nearest = uut[i].next_expiry;
+            if (uut[i].running && (uut[i].current.peripheral & STREAM_PROGRESS) &&
+                (nearest < 0 || progress_next(&uut[i]) < nearest)) {
+                nearest = progress_next(&uut[i]);
+            }
+        }
+        int wait_ms = nearest < 0 ? -1 : nearest <= now ? 0 : (int)((nearest - now) * 1000.0) + 1;
+
+        int ready = poll(fds, uuts, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll failed");
+            break;
+        }
+
+        now = now_sec();
+        for (long i = 0; i < uuts; i++) {
+            if (fds[i].revents & POLLIN) serve_uut(&uut[i], now);
+            advance(&uut[i], now);
+            flush_replies(&uut[i]);
+        }
+    }
+
+    print_stats(uut, uuts, port);
+    for (long i = 0; i < uuts; i++) close(fds[i].fd);
+    free(uut);
+    free(fds);
+    return 0;
+}